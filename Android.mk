@@ -33,6 +33,7 @@ LOCAL_REQUIRED_MODULES := \
 LOCAL_SRC_FILES := \
     C2FFMPEGAudioDecodeComponent.cpp \
     C2FFMPEGAudioDecodeInterface.cpp \
+    C2FFMPEGPendingWorkQueue.cpp \
     C2FFMPEGVideoDecodeComponent.cpp \
     C2FFMPEGVideoDecodeInterface.cpp \
     service.cpp
@@ -0,0 +1,183 @@
+/*
+ * Copyright (C) 2024 KonstaKANG
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <algorithm>
+#include "C2FFMPEGPendingWorkQueue.h"
+
+namespace android {
+
+// Enough for the largest output delay without growing.
+static constexpr size_t kInitialSlots = 64;
+static constexpr size_t kNoSlot = SIZE_MAX;
+
+C2FFMPEGPendingWorkQueue::C2FFMPEGPendingWorkQueue()
+    : mSlots(kInitialSlots, kEmptySlot),
+      mSlotMask(kInitialSlots - 1),
+      mSequence(0) {
+    mHeap.reserve(kInitialSlots / 2);
+}
+
+size_t C2FFMPEGPendingWorkQueue::hashSlot(uint64_t index) const {
+    // Frame indexes are mostly consecutive, spread them over the table.
+    return (size_t)((index * 0x9E3779B97F4A7C15ull) >> 32) & mSlotMask;
+}
+
+size_t C2FFMPEGPendingWorkQueue::findSlot(uint64_t index) const {
+    for (size_t slot = hashSlot(index); mSlots[slot] != kEmptySlot; slot = (slot + 1) & mSlotMask) {
+        if (mHeap[mSlots[slot]].index == index) {
+            return slot;
+        }
+    }
+    return kNoSlot;
+}
+
+void C2FFMPEGPendingWorkQueue::freeSlot(size_t slot) {
+    size_t hole = slot;
+
+    // Linear probing: shift the following entries back instead of leaving
+    // tombstones, so lookups never degrade.
+    mSlots[hole] = kEmptySlot;
+    for (size_t next = (hole + 1) & mSlotMask; mSlots[next] != kEmptySlot; next = (next + 1) & mSlotMask) {
+        size_t home = hashSlot(mHeap[mSlots[next]].index);
+
+        if (((next - home) & mSlotMask) >= ((next - hole) & mSlotMask)) {
+            mSlots[hole] = mSlots[next];
+            mHeap[mSlots[hole]].slot = hole;
+            mSlots[next] = kEmptySlot;
+            hole = next;
+        }
+    }
+}
+
+void C2FFMPEGPendingWorkQueue::rehash(size_t slots) {
+    mSlots.assign(slots, kEmptySlot);
+    mSlotMask = slots - 1;
+    for (size_t pos = 0; pos < mHeap.size(); pos++) {
+        size_t slot = hashSlot(mHeap[pos].index);
+
+        while (mSlots[slot] != kEmptySlot) {
+            slot = (slot + 1) & mSlotMask;
+        }
+        mSlots[slot] = (int32_t)pos;
+        mHeap[pos].slot = slot;
+    }
+}
+
+void C2FFMPEGPendingWorkQueue::place(size_t pos, const Entry& entry) {
+    mHeap[pos] = entry;
+    mSlots[entry.slot] = (int32_t)pos;
+}
+
+void C2FFMPEGPendingWorkQueue::siftUp(size_t pos) {
+    Entry entry = mHeap[pos];
+
+    while (pos > 0) {
+        size_t parent = (pos - 1) / 2;
+
+        if (! before(entry, mHeap[parent])) {
+            break;
+        }
+        place(pos, mHeap[parent]);
+        pos = parent;
+    }
+    place(pos, entry);
+}
+
+void C2FFMPEGPendingWorkQueue::siftDown(size_t pos) {
+    Entry entry = mHeap[pos];
+    size_t count = mHeap.size();
+
+    for (;;) {
+        size_t child = 2 * pos + 1;
+
+        if (child >= count) {
+            break;
+        }
+        if (child + 1 < count && before(mHeap[child + 1], mHeap[child])) {
+            child++;
+        }
+        if (! before(mHeap[child], entry)) {
+            break;
+        }
+        place(pos, mHeap[child]);
+        pos = child;
+    }
+    place(pos, entry);
+}
+
+void C2FFMPEGPendingWorkQueue::removeAt(size_t pos) {
+    freeSlot(mHeap[pos].slot);
+
+    Entry last = mHeap.back();
+
+    mHeap.pop_back();
+    if (pos == mHeap.size()) {
+        return;
+    }
+    place(pos, last);
+    if (pos > 0 && before(last, mHeap[(pos - 1) / 2])) {
+        siftUp(pos);
+    } else {
+        siftDown(pos);
+    }
+}
+
+void C2FFMPEGPendingWorkQueue::push(uint64_t index, uint64_t timestamp) {
+    // Frame indexes are unique, a resubmitted one replaces the old entry.
+    erase(index);
+
+    // Keep the load factor at or below 1/2.
+    if ((mHeap.size() + 1) * 2 > mSlots.size()) {
+        rehash(mSlots.size() * 2);
+    }
+
+    size_t slot = hashSlot(index);
+
+    while (mSlots[slot] != kEmptySlot) {
+        slot = (slot + 1) & mSlotMask;
+    }
+    mHeap.push_back(Entry{ index, timestamp, mSequence++, slot });
+    mSlots[slot] = (int32_t)(mHeap.size() - 1);
+    siftUp(mHeap.size() - 1);
+}
+
+bool C2FFMPEGPendingWorkQueue::erase(uint64_t index) {
+    size_t slot = findSlot(index);
+
+    if (slot == kNoSlot) {
+        return false;
+    }
+    removeAt(mSlots[slot]);
+    return true;
+}
+
+bool C2FFMPEGPendingWorkQueue::contains(uint64_t index) const {
+    return findSlot(index) != kNoSlot;
+}
+
+uint64_t C2FFMPEGPendingWorkQueue::popFront() {
+    uint64_t index = mHeap.front().index;
+
+    removeAt(0);
+    return index;
+}
+
+void C2FFMPEGPendingWorkQueue::clear() {
+    mHeap.clear();
+    std::fill(mSlots.begin(), mSlots.end(), kEmptySlot);
+}
+
+} // namespace android
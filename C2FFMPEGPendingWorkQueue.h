@@ -0,0 +1,82 @@
+/*
+ * Copyright (C) 2024 KonstaKANG
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef C2_FFMPEG_PENDING_WORK_QUEUE_H
+#define C2_FFMPEG_PENDING_WORK_QUEUE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+namespace android {
+
+// Works waiting for a decoded picture, ordered by timestamp and looked up by
+// frame index. This is a binary min-heap indexed by an open addressing hash
+// table: push, erase and pop are O(log n), lookup is O(1), and storage is
+// only reallocated when the number of works exceeds its previous maximum.
+// Works with the same timestamp come out in push order. Not thread-safe.
+class C2FFMPEGPendingWorkQueue {
+public:
+    C2FFMPEGPendingWorkQueue();
+
+    size_t size() const { return mHeap.size(); }
+    bool empty() const { return mHeap.empty(); }
+
+    void push(uint64_t index, uint64_t timestamp);
+    // Returns false if no work has this frame index.
+    bool erase(uint64_t index);
+    bool contains(uint64_t index) const;
+    // Earliest work, the queue must not be empty.
+    uint64_t frontIndex() const { return mHeap.front().index; }
+    uint64_t frontTimestamp() const { return mHeap.front().timestamp; }
+    // Removes the earliest work and returns its frame index.
+    uint64_t popFront();
+    void clear();
+
+private:
+    struct Entry {
+        uint64_t index;
+        uint64_t timestamp;
+        uint64_t sequence;
+        // Position of the entry in mSlots.
+        size_t slot;
+    };
+
+    static constexpr int32_t kEmptySlot = -1;
+
+    bool before(const Entry& e1, const Entry& e2) const {
+        return e1.timestamp < e2.timestamp ||
+               (e1.timestamp == e2.timestamp && e1.sequence < e2.sequence);
+    }
+    size_t hashSlot(uint64_t index) const;
+    size_t findSlot(uint64_t index) const;
+    void freeSlot(size_t slot);
+    void rehash(size_t slots);
+    void place(size_t pos, const Entry& entry);
+    void siftUp(size_t pos);
+    void siftDown(size_t pos);
+    void removeAt(size_t pos);
+
+    std::vector<Entry> mHeap;
+    // Heap position of each work, kEmptySlot if unused.
+    std::vector<int32_t> mSlots;
+    size_t mSlotMask;
+    uint64_t mSequence;
+};
+
+} // namespace android
+
+#endif // C2_FFMPEG_PENDING_WORK_QUEUE_H
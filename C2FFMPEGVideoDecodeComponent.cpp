@@ -18,17 +18,105 @@
 #include <android-base/properties.h>
 #include <log/log.h>
 #include <algorithm>
+#include <cmath>
+#include <iterator>
 
 #include <SimpleC2Interface.h>
 #include "C2FFMPEGVideoDecodeComponent.h"
+#include "ffmpeg_budget.h"
+#include "ffmpeg_convert.h"
+#include "ffmpeg_decoderpool.h"
+#include "ffmpeg_framequeue.h"
 #include "ffmpeg_hwaccel.h"
+#include "ffmpeg_threadpool.h"
 
 #define DEBUG_FRAMES 0
 #define DEBUG_WORKQUEUE 0
 #define DEBUG_EXTRADATA 0
+#define DEBUG_DIRECT_RENDERING 0
+#define DEBUG_OUTPUT_STAGE 0
+#define DEBUG_HORIZ_BAND 0
+#define DEBUG_LATENCY 0
 
 namespace android {
 
+// Frames waiting for the output thread, decoding stalls beyond that.
+constexpr size_t kOutputQueueSize = 4;
+constexpr uint64_t kNoWorkIndex = UINT64_MAX;
+// Pictures being converted band by band, older ones are given up.
+constexpr size_t kMaxBandBuffers = 4;
+// Output delay is lowered after this many works with a reorder depth at
+// least this much below it.
+constexpr int kOutputDelayShrinkWorks = 120;
+constexpr uint32_t kOutputDelayShrinkMargin = 2;
+// Decoder threads: one per this many samples, up to the libavcodec limit
+// of automatic threading.
+constexpr int kPixelsPerThread = 640 * 360;
+constexpr int kMaxThreads = 16;
+// Share of the shared worker pool, interactive sessions get more.
+constexpr int kThreadWeight = 1;
+constexpr int kLowLatencyThreadWeight = 4;
+// Decoding load, in percent of the frame interval, measured over windows
+// of works: above kDegradeLoad the next degradation level is applied, and
+// the previous one back after kRecoverWindows windows below kRecoverLoad.
+constexpr int kDegradationWindow = 30;
+constexpr int kDegradeLoad = 90;
+constexpr int kRecoverLoad = 60;
+constexpr int kRecoverWindows = 3;
+
+// Attached to each packet and copied by libavcodec to the frames decoded
+// from it, so that a frame maps back to its work whatever the reordering.
+struct C2FFMPEGFrameInfo {
+    uint64_t frameIndex;
+    uint64_t timestamp;
+    // When the packet was sent, for latency statistics.
+    nsecs_t inputTime;
+};
+
+// Parameter sets come as codec config, and may also come in-band.
+static bool hasCodecConfig(enum AVCodecID codecID) {
+    return codecID == AV_CODEC_ID_H264 || codecID == AV_CODEC_ID_HEVC ||
+           codecID == AV_CODEC_ID_AV1 || codecID == AV_CODEC_ID_MPEG4 ||
+           codecID == AV_CODEC_ID_MPEG2VIDEO;
+}
+
+// Work a decoded frame belongs to.
+static uint64_t getFrameIndex(const AVFrame* frame) {
+#ifdef AV_CODEC_FLAG_COPY_OPAQUE
+    if (frame->opaque_ref) {
+        return ((const C2FFMPEGFrameInfo*)frame->opaque_ref->data)->frameIndex;
+    }
+#endif
+    // The frame index is also passed as the packet PTS.
+    return frame->best_effort_timestamp;
+}
+
+// Graphic block lent to libavcodec through get_buffer2(). The block stays
+// mapped for as long as the decoder holds a reference to the AVBuffer.
+struct C2FFMPEGDirectBuffer {
+    C2FFMPEGVideoDecodeComponent* owner;
+    std::shared_ptr<C2GraphicBlock> block;
+    C2GraphicView view;
+};
+
+// Graphic block filled from draw_horiz_band() while the picture is decoded.
+// Bands may come from slice threads in any order, rows are tracked one by
+// one so that the block is only used once the whole picture is converted.
+struct C2FFMPEGBandBuffer {
+    const uint8_t* picture;
+    int64_t pts;
+    int width;
+    int height;
+    uint32_t format;
+    std::shared_ptr<C2GraphicBlock> block;
+    C2GraphicView view;
+    uint8_t* data[4];
+    int linesize[4];
+    enum AVPixelFormat dstFormat;
+    std::vector<bool> rows;
+    int rowsDone;
+};
+
 C2FFMPEGVideoDecodeComponent::C2FFMPEGVideoDecodeComponent(
         const C2FFMPEGComponentInfo* componentInfo,
         const std::shared_ptr<C2FFMPEGVideoDecodeInterface>& intf)
@@ -37,13 +125,58 @@ C2FFMPEGVideoDecodeComponent::C2FFMPEGVideoDecodeComponent(
       mIntf(intf),
       mCodecID(componentInfo->codecID),
       mCtx(NULL),
-      mImgConvertCtx(NULL),
+      mImgConvertCtx{},
       mFrame(NULL),
       mPacket(NULL),
+      mFrameInfoPool(NULL),
+      mBsf(NULL),
+      mBsfPacket(NULL),
+      mBsfPending(false),
       mFFMPEGInitialized(false),
       mCodecAlreadyOpened(false),
       mExtradataReady(false),
-      mEOSSignalled(false) {
+      mWarmReset(false),
+      mBackgroundOpen(false),
+      mOpenResult(C2_OK),
+      mSpeculativeOpen(false),
+      mEOSSignalled(false),
+      mDirectRendering(false),
+      mDirectFrames(0),
+      mCopiedFrames(0),
+      mDrawHorizBand(false),
+      mOutputFormat(0),
+      mDelayShrinkCount(0),
+      mDelayHighWater(0),
+      mStreamInfo{},
+      mStreamInfoProbed(false),
+      mLowLatency(false),
+      mThreadSession(NULL),
+      mCpuCount(0),
+      mBudgetThreads(0),
+      mBudgetOutputDelay(0),
+      mFastCtx(NULL),
+      mFastStart(false),
+      mFastStartPending(false),
+      mFastStartPacket(NULL),
+      mFastStartIndex(kNoWorkIndex),
+      mStandbyCtx(NULL),
+      mStandbyOpening(NULL),
+      mStandbyStopping(false),
+      mDegradation(false),
+      mDegradationLevel(0),
+      mDegradationWorks(0),
+      mDegradationTime(0),
+      mDegradationMinTs(0),
+      mDegradationMaxTs(0),
+      mRecoverWindows(0),
+      mLatencyFrames(0),
+      mLatencySum(0),
+      mLatencyMax(0),
+      mOutputPending(0),
+      mOutputFlushing(false),
+      mOutputStopping(false),
+      mCurrentWorkIndex(kNoWorkIndex),
+      mCurrentWorkQueued(false) {
     ALOGD("C2FFMPEGVideoDecodeComponent: mediaType = %s", componentInfo->mediaType);
 }
 
@@ -61,6 +194,11 @@ c2_status_t C2FFMPEGVideoDecodeComponent::initDecoder() {
         mFFMPEGInitialized = true;
     }
 
+    if (mWarmReset) {
+        // Kept open by onReset().
+        return C2_OK;
+    }
+
     mCtx = avcodec_alloc_context3(NULL);
     if (! mCtx) {
         ALOGE("initDecoder: avcodec_alloc_context failed.");
@@ -86,6 +224,247 @@ c2_status_t C2FFMPEGVideoDecodeComponent::initDecoder() {
     return C2_OK;
 }
 
+void C2FFMPEGVideoDecodeComponent::configureContext(AVCodecContext* ctx) {
+    ctx->workaround_bugs   = 1;
+    ctx->idct_algo         = 0;
+    ctx->skip_idct         = AVDISCARD_DEFAULT;
+    ctx->error_concealment = 3;
+    planThreading(&ctx->thread_type, &ctx->thread_count);
+    // Frames keep their decoded size, the crop is passed to the consumer.
+    ctx->apply_cropping    = 0;
+#ifdef AV_CODEC_FLAG_COPY_OPAQUE
+    ctx->flags            |= AV_CODEC_FLAG_COPY_OPAQUE;
+#endif
+    applyDegradation(ctx);
+}
+
+// Frame threads pick the settings up with the next packet.
+void C2FFMPEGVideoDecodeComponent::applyDegradation(AVCodecContext* ctx) {
+    if (mDegradationLevel >= 1 || base::GetBoolProperty("debug.ffmpeg_codec2.fast", false)) {
+        ctx->flags2 |= AV_CODEC_FLAG2_FAST;
+    } else {
+        ctx->flags2 &= ~AV_CODEC_FLAG2_FAST;
+    }
+    ctx->skip_loop_filter = mDegradationLevel >= 2 ? AVDISCARD_NONREF : AVDISCARD_DEFAULT;
+    ctx->skip_frame = mDegradationLevel >= 3 ? AVDISCARD_NONREF : AVDISCARD_DEFAULT;
+}
+
+// Decoding falling behind the frame rate only gets worse: give up some
+// quality, and get it back once there is headroom again. Only the time
+// spent in libavcodec counts, not waiting for output buffers.
+void C2FFMPEGVideoDecodeComponent::updateDegradation(
+    const std::unique_ptr<C2Work>& work, nsecs_t decodeTime
+) {
+    uint64_t timestamp = work->input.ordinal.timestamp.peeku();
+
+    if (mDegradationWorks == 0) {
+        mDegradationTime = 0;
+        mDegradationMinTs = timestamp;
+        mDegradationMaxTs = timestamp;
+    }
+    mDegradationTime += decodeTime;
+    mDegradationMinTs = std::min(mDegradationMinTs, timestamp);
+    mDegradationMaxTs = std::max(mDegradationMaxTs, timestamp);
+    if (++mDegradationWorks < kDegradationWindow) {
+        return;
+    }
+
+    // Timestamps come in decoding order, their span gives the frame interval.
+    nsecs_t interval = us2ns((nsecs_t)(mDegradationMaxTs - mDegradationMinTs)) / (mDegradationWorks - 1);
+    int works = mDegradationWorks;
+
+    mDegradationWorks = 0;
+    if (interval <= 0) {
+        return;
+    }
+
+    int load = (int)(mDegradationTime * 100 / (interval * works));
+    uint32_t level = mDegradationLevel;
+
+    if (load > kDegradeLoad && level < kMaxDegradationLevel) {
+        level++;
+        mRecoverWindows = 0;
+    } else if (load < kRecoverLoad && level > 0) {
+        if (++mRecoverWindows >= kRecoverWindows) {
+            level--;
+            mRecoverWindows = 0;
+        }
+    } else {
+        mRecoverWindows = 0;
+    }
+
+    if (level != mDegradationLevel) {
+        ALOGD("updateDegradation: load = %d%% of %" PRId64 " us, level %u -> %u",
+              load, ns2us(interval), mDegradationLevel, level);
+
+        std::vector<std::unique_ptr<C2Param>> configUpdate;
+
+        setDegradationLevel(level, &configUpdate);
+        // The work may be held back for reordering.
+        sendConfigUpdate(work, configUpdate);
+    }
+}
+
+void C2FFMPEGVideoDecodeComponent::setDegradationLevel(
+    uint32_t level, std::vector<std::unique_ptr<C2Param>>* configUpdate
+) {
+    mDegradationLevel = level;
+    if (mCtx) {
+        applyDegradation(mCtx);
+    }
+    mIntf->setDegradationLevel(level);
+    if (configUpdate) {
+        configUpdate->push_back(C2Param::Copy(C2StreamFFmpegDegradationLevelInfo::output(0u, level)));
+    }
+}
+
+c2_status_t C2FFMPEGVideoDecodeComponent::openFastStartDecoder() {
+    const AVCodec* codec = avcodec_find_decoder(mCtx->codec_id);
+
+    mFastCtx = avcodec_alloc_context3(codec);
+    if (! mFastCtx) {
+        ALOGE("openFastStartDecoder: avcodec_alloc_context failed.");
+        return C2_NO_MEMORY;
+    }
+
+    configureContext(mFastCtx);
+    mFastCtx->thread_type = FF_THREAD_SLICE;
+    mFastCtx->width = mCtx->width;
+    mFastCtx->height = mCtx->height;
+    if (mCtx->extradata_size) {
+        mFastCtx->extradata = (uint8_t*)av_mallocz(mCtx->extradata_size + AV_INPUT_BUFFER_PADDING_SIZE);
+        if (! mFastCtx->extradata) {
+            ALOGE("openFastStartDecoder: oom for extradata");
+            return C2_NO_MEMORY;
+        }
+        memcpy(mFastCtx->extradata, mCtx->extradata, mCtx->extradata_size);
+        mFastCtx->extradata_size = mCtx->extradata_size;
+    }
+
+    int err = avcodec_open2(mFastCtx, codec, NULL);
+    if (err < 0) {
+        ALOGE("openFastStartDecoder: failed to initialize. (%s)", av_err2str(err));
+        return C2_NO_INIT;
+    }
+
+    attachThreadPool(mFastCtx);
+    reserveMemory();
+
+    ALOGD("openFastStartDecoder: threads = %d", mFastCtx->thread_count);
+
+    return C2_OK;
+}
+
+// Only a key frame without leading pictures starts the fast path: the main
+// decoder outputs nothing decoded after it ahead of it. The packet is taken
+// as the main decoder accepted it, filtered and with the late codec config.
+void C2FFMPEGVideoDecodeComponent::keepFastStartPacket(const AVPacket* packet) {
+    if (! mFastStartPending || ! mFastStartPacket || mFastStartPacket->data ||
+            ! ffmpeg_is_key_frame(mCodecID, packet->data, packet->size)) {
+        return;
+    }
+    if (av_packet_ref(mFastStartPacket, packet) < 0) {
+        ALOGE("keepFastStartPacket: oom for packet");
+    }
+}
+
+void C2FFMPEGVideoDecodeComponent::decodeFastStart(
+    const std::unique_ptr<C2Work>& work,
+    const std::shared_ptr<C2BlockPool>& pool
+) {
+    uint64_t frameIndex = work->input.ordinal.frameIndex.peeku();
+
+    mFastStartPending = false;
+    if (! mFastCtx && openFastStartDecoder() != C2_OK) {
+        // Not worth retrying, the main decoder does the job anyway.
+        avcodec_free_context(&mFastCtx);
+        av_packet_unref(mFastStartPacket);
+        mFastStart = false;
+        return;
+    }
+
+    // Drain right away, so that the picture is out whatever the reorder
+    // depth of the stream.
+    int err = avcodec_send_packet(mFastCtx, mFastStartPacket);
+    av_packet_unref(mFastStartPacket);
+    if (err >= 0) {
+        err = avcodec_send_packet(mFastCtx, NULL);
+    }
+
+    bool output = false;
+
+    while (err >= 0) {
+        err = avcodec_receive_frame(mFastCtx, mFrame);
+        if (err >= 0 && ! output && getFrameIndex(mFrame) == frameIndex) {
+            output = (mOutputQueue ? queueFrame() : outputFrame(work, pool)) == C2_OK;
+        }
+        av_frame_unref(mFrame);
+    }
+    avcodec_flush_buffers(mFastCtx);
+
+    if (output) {
+        // The main decoder outputs it later, drop that one.
+        mFastStartIndex = frameIndex;
+    }
+    ALOGD("decodeFastStart: idx=%" PRIu64 " %s", frameIndex, output ? "output" : "not decoded");
+}
+
+// Opened or flushed: wait for the next key frame.
+void C2FFMPEGVideoDecodeComponent::resetFastStart() {
+    mFastStartPending = mFastStart;
+    mFastStartIndex = kNoWorkIndex;
+    if (mFastStartPacket) {
+        av_packet_unref(mFastStartPacket);
+    }
+}
+
+// libavcodec's own slice threads are still created, but stay idle.
+void C2FFMPEGVideoDecodeComponent::attachThreadPool(AVCodecContext* ctx) {
+    if (! mThreadSession || ctx->active_thread_type != FF_THREAD_SLICE || ctx->thread_count <= 1) {
+        return;
+    }
+
+    ALOGD("attachThreadPool: %d slice threads on the shared pool", ctx->thread_count);
+    ctx->opaque = this;
+    ctx->execute = execute;
+    ctx->execute2 = execute2;
+}
+
+int C2FFMPEGVideoDecodeComponent::execute(
+    AVCodecContext* ctx, int (*func)(AVCodecContext* c2, void* arg),
+    void* arg, int* ret, int count, int size
+) {
+    C2FFMPEGVideoDecodeComponent* me = (C2FFMPEGVideoDecodeComponent*)ctx->opaque;
+
+    FFmpegThreadPool::instance().parallelFor(me->mThreadSession, count, ctx->thread_count,
+                                             [&](int job, int) {
+        int r = func(ctx, (uint8_t*)arg + (size_t)job * size);
+
+        if (ret) {
+            ret[job] = r;
+        }
+    });
+    return 0;
+}
+
+int C2FFMPEGVideoDecodeComponent::execute2(
+    AVCodecContext* ctx, int (*func)(AVCodecContext* c2, void* arg, int jobnr, int threadnr),
+    void* arg, int* ret, int count
+) {
+    C2FFMPEGVideoDecodeComponent* me = (C2FFMPEGVideoDecodeComponent*)ctx->opaque;
+
+    // Slots are the thread numbers, codecs keep per thread state.
+    FFmpegThreadPool::instance().parallelFor(me->mThreadSession, count, ctx->thread_count,
+                                             [&](int job, int thread) {
+        int r = func(ctx, arg, job, thread);
+
+        if (ret) {
+            ret[job] = r;
+        }
+    });
+    return 0;
+}
+
 c2_status_t C2FFMPEGVideoDecodeComponent::openDecoder() {
     if (mCodecAlreadyOpened) {
         return C2_OK;
@@ -111,24 +490,50 @@ c2_status_t C2FFMPEGVideoDecodeComponent::openDecoder() {
     }
 
     // Configure decoder.
-    mCtx->workaround_bugs   = 1;
-    mCtx->idct_algo         = 0;
-    mCtx->skip_frame        = AVDISCARD_DEFAULT;
-    mCtx->skip_idct         = AVDISCARD_DEFAULT;
-    mCtx->skip_loop_filter  = AVDISCARD_DEFAULT;
-    mCtx->error_concealment = 3;
-    mCtx->thread_count      = base::GetIntProperty("debug.ffmpeg_codec2.threads", 0);
-
-    if (base::GetBoolProperty("debug.ffmpeg_codec2.fast", false)) {
-        mCtx->flags2 |= AV_CODEC_FLAG2_FAST;
+    configureContext(mCtx);
+    // Frame threading delays the output by a picture per thread, and the
+    // reorder buffer by up to 16: slice threading and output in decoding
+    // order only. Streams with B-frames are output as soon as decoded.
+    mLowLatency = mIntf->getLowLatencyMode();
+    if (mLowLatency) {
+        mCtx->thread_type   = FF_THREAD_SLICE;
+        mCtx->flags        |= AV_CODEC_FLAG_LOW_DELAY;
     }
+    reserveMemory();
 
     ffmpeg_hwaccel_init(mCtx);
 
-    ALOGD("openDecoder: opening ffmpeg decoder(%s): threads = %d, hw = %s",
-          avcodec_get_name(mCtx->codec_id), mCtx->thread_count, mCtx->hw_device_ctx ? "yes" : "no");
+    // Let the decoder write into graphic blocks directly when it supports
+    // custom buffers. HW frames are always transferred, so skip them.
+    mDirectRendering = base::GetBoolProperty("persist.ffmpeg_codec2.direct_rendering", false) &&
+                       (mCtx->codec->capabilities & AV_CODEC_CAP_DR1) &&
+                       ! mCtx->hw_device_ctx;
+    if (mDirectRendering) {
+        mCtx->opaque = this;
+        mCtx->get_buffer2 = getBuffer2;
+    }
+
+    ALOGD("openDecoder: opening ffmpeg decoder(%s): threads = %d, hw = %s, direct = %s, low latency = %s",
+          avcodec_get_name(mCtx->codec_id), mCtx->thread_count, mCtx->hw_device_ctx ? "yes" : "no",
+          mDirectRendering ? "yes" : "no", mLowLatency ? "yes" : "no");
+
+    // Optional bitstream filters in front of the decoder, e.g. to convert
+    // or extract in-band parameter sets. Decoding works without them.
+    std::string filters = base::GetProperty("persist.ffmpeg_codec2.bsf", "");
+
+    if (! filters.empty() && initBitstreamFilter(filters) != C2_OK) {
+        deInitBitstreamFilter();
+    }
+
+    AVDictionary* opts = NULL;
 
-    int err = avcodec_open2(mCtx, mCtx->codec, NULL);
+    if (mLowLatency && strcmp(mCtx->codec->name, "libdav1d") == 0) {
+        // libdav1d pipelines frames internally instead of frame threads.
+        av_dict_set(&opts, "max_frame_delay", "1", 0);
+    }
+
+    int err = avcodec_open2(mCtx, mCtx->codec, &opts);
+    av_dict_free(&opts);
     if (err < 0) {
         ALOGE("openDecoder: ffmpeg video decoder failed to initialize. (%s)", av_err2str(err));
         return C2_NO_INIT;
@@ -138,17 +543,274 @@ c2_status_t C2FFMPEGVideoDecodeComponent::openDecoder() {
     ALOGD("openDecoder: open ffmpeg video decoder(%s) success, caps = %08x",
           avcodec_get_name(mCtx->codec_id), mCtx->codec->capabilities);
 
+    return attachDecoder();
+}
+
+// Per component state of an opened decoder, also used when adopting one.
+c2_status_t C2FFMPEGVideoDecodeComponent::attachDecoder() {
+#ifdef AV_CODEC_FLAG_COPY_OPAQUE
+    mFrameInfoPool = av_buffer_pool_init(sizeof(C2FFMPEGFrameInfo), NULL);
+    if (! mFrameInfoPool) {
+        ALOGE("attachDecoder: oom for frame info pool");
+        return C2_NO_MEMORY;
+    }
+#endif
+
+    // Run slice jobs and conversions of all the instances on one pool,
+    // rather than a set of threads per instance. An adopted decoder may
+    // already run its slice jobs there.
+    if (base::GetBoolProperty("persist.ffmpeg_codec2.shared_threads", false) ||
+            mCtx->execute == execute) {
+        mThreadSession = FFmpegThreadPool::instance().createSession(
+                mLowLatency ? kLowLatencyThreadWeight : kThreadWeight);
+        attachThreadPool(mCtx);
+    }
+
+    // Convert rows as soon as they are decoded, while still in cache. With
+    // frame threading, bands of several pictures would compete instead.
+    mDrawHorizBand = base::GetBoolProperty("persist.ffmpeg_codec2.draw_horiz_band", false) &&
+                     (mCtx->codec->capabilities & AV_CODEC_CAP_DRAW_HORIZ_BAND) &&
+                     ! (mCtx->active_thread_type & FF_THREAD_FRAME) &&
+                     ! mCtx->hw_device_ctx && ! mDirectRendering;
+    if (mDrawHorizBand) {
+        ALOGD("attachDecoder: converting in bands");
+        mCtx->opaque = this;
+        mCtx->draw_horiz_band = drawHorizBand;
+    }
+
     mFrame = av_frame_alloc();
     if (! mFrame) {
-        ALOGE("openDecoder: oom for video frame");
+        ALOGE("attachDecoder: oom for video frame");
         return C2_NO_MEMORY;
     }
 
+    // Frame threads only output once they are all busy, and their contexts
+    // are set up on the first packets: decode the first picture after
+    // opening or flushing on a slice threaded decoder as well.
+    mFastStart = base::GetBoolProperty("persist.ffmpeg_codec2.fast_start", false) &&
+                 (mCtx->active_thread_type & FF_THREAD_FRAME) && ! mLowLatency;
+    if (mFastStart && ! mFastStartPacket) {
+        mFastStartPacket = av_packet_alloc();
+        mFastStart = mFastStartPacket != NULL;
+    }
+    resetFastStart();
+
+    // Move block fetching and conversion off the decoding thread. Its
+    // queue would delay low latency output.
+    if (base::GetBoolProperty("persist.ffmpeg_codec2.output_thread", false) && ! mLowLatency) {
+        startOutputThread();
+    }
+
+    // Real time sessions only, others have no frame rate to keep up with.
+    mDegradation = base::GetBoolProperty("persist.ffmpeg_codec2.degradation", false) &&
+                   mIntf->isRealTime();
+
+    // Flushing waits for every frame thread to finish its picture, seeks
+    // swap in a standby decoder instead. It doubles the memory held, so not
+    // with a memory budget.
+    if (base::GetBoolProperty("persist.ffmpeg_codec2.fast_flush", false) &&
+            (mCtx->active_thread_type & FF_THREAD_FRAME) && ! mDirectRendering &&
+            ! mCtx->hw_device_ctx && ! FFmpegMemoryBudget::instance().getLimit()) {
+        startStandbyThread();
+    }
+
     return C2_OK;
 }
 
+// Same parameters as the decoder, not opened yet.
+AVCodecContext* C2FFMPEGVideoDecodeComponent::createStandbyContext() {
+    AVCodecContext* ctx = avcodec_alloc_context3(mCtx->codec);
+
+    if (! ctx) {
+        ALOGE("createStandbyContext: avcodec_alloc_context failed.");
+        return NULL;
+    }
+
+    configureContext(ctx);
+    ctx->thread_type = mCtx->thread_type;
+    ctx->thread_count = mCtx->thread_count;
+    ctx->flags = mCtx->flags;
+    ctx->flags2 = mCtx->flags2;
+    ctx->width = mCtx->width;
+    ctx->height = mCtx->height;
+    if (mCtx->extradata_size) {
+        ctx->extradata = (uint8_t*)av_mallocz(mCtx->extradata_size + AV_INPUT_BUFFER_PADDING_SIZE);
+        if (! ctx->extradata) {
+            ALOGE("createStandbyContext: oom for extradata");
+            avcodec_free_context(&ctx);
+            return NULL;
+        }
+        memcpy(ctx->extradata, mCtx->extradata, mCtx->extradata_size);
+        ctx->extradata_size = mCtx->extradata_size;
+    }
+    return ctx;
+}
+
+void C2FFMPEGVideoDecodeComponent::startStandbyThread() {
+    mStandbyOpening = createStandbyContext();
+    if (! mStandbyOpening) {
+        return;
+    }
+    mStandbyStopping = false;
+    mStandbyThread = std::thread(&C2FFMPEGVideoDecodeComponent::standbyThreadLoop, this);
+
+    ALOGD("startStandbyThread: fast flush enabled");
+}
+
+void C2FFMPEGVideoDecodeComponent::stopStandbyThread() {
+    if (! mStandbyThread.joinable()) {
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mStandbyLock);
+        mStandbyStopping = true;
+    }
+    mStandbyCond.notify_all();
+    mStandbyThread.join();
+
+    avcodec_free_context(&mStandbyCtx);
+    avcodec_free_context(&mStandbyOpening);
+    for (AVCodecContext* ctx : mRetiredCtxs) {
+        avcodec_free_context(&ctx);
+    }
+    mRetiredCtxs.clear();
+}
+
+// Opens the standby decoder, and flushes replaced decoders to make them the
+// next standby one.
+void C2FFMPEGVideoDecodeComponent::standbyThreadLoop() {
+    std::unique_lock<std::mutex> lock(mStandbyLock);
+
+    while (true) {
+        mStandbyCond.wait(lock, [this] {
+            return mStandbyStopping || mStandbyOpening || ! mRetiredCtxs.empty();
+        });
+        if (mStandbyStopping) {
+            break;
+        }
+
+        std::deque<AVCodecContext*> unused;
+        AVCodecContext* ctx;
+
+        if (mStandbyOpening) {
+            ctx = mStandbyOpening;
+            mStandbyOpening = NULL;
+            lock.unlock();
+
+            int err = avcodec_open2(ctx, ctx->codec, NULL);
+
+            if (err < 0) {
+                ALOGE("standbyThreadLoop: failed to open standby decoder. (%s)", av_err2str(err));
+                avcodec_free_context(&ctx);
+            }
+        } else {
+            // Only the last decoder replaced is kept, the earlier ones were
+            // decoding for seeks superseded already: drop their pictures.
+            ctx = mRetiredCtxs.back();
+            mRetiredCtxs.pop_back();
+            unused.swap(mRetiredCtxs);
+            lock.unlock();
+
+            avcodec_flush_buffers(ctx);
+        }
+
+        lock.lock();
+        if (ctx && ! mStandbyCtx) {
+            mStandbyCtx = ctx;
+        } else if (ctx) {
+            unused.push_back(ctx);
+        }
+        if (! unused.empty()) {
+            lock.unlock();
+            for (AVCodecContext* c : unused) {
+                avcodec_free_context(&c);
+            }
+            lock.lock();
+        }
+    }
+}
+
+// Swaps in the standby decoder, or a new one if the previous seek did not
+// leave the time to prepare it. Returns false if neither is available.
+bool C2FFMPEGVideoDecodeComponent::swapStandbyDecoder() {
+    AVCodecContext* standby;
+
+    {
+        std::lock_guard<std::mutex> lock(mStandbyLock);
+
+        standby = mStandbyCtx;
+        mStandbyCtx = NULL;
+    }
+
+    if (! standby) {
+        standby = createStandbyContext();
+        if (standby && avcodec_open2(standby, standby->codec, NULL) < 0) {
+            avcodec_free_context(&standby);
+        }
+        if (! standby) {
+            return false;
+        }
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mStandbyLock);
+
+        mRetiredCtxs.push_back(mCtx);
+    }
+    mStandbyCond.notify_all();
+    mCtx = standby;
+    applyDegradation(mCtx);
+
+    // It only knows the codec config it was opened with.
+    mPendingConfig = mLateConfig;
+
+    return true;
+}
+
+// State of the stream being decoded, dropped whether the decoder is closed
+// or kept for the next one.
+void C2FFMPEGVideoDecodeComponent::resetStreamState() {
+    mLateConfig.clear();
+    if (mDegradationLevel) {
+        setDegradationLevel(0, NULL);
+    }
+    mDegradationWorks = 0;
+    mRecoverWindows = 0;
+    {
+        std::lock_guard<std::mutex> lock(mLatencyLock);
+
+        if (mLatencyFrames) {
+            ALOGD("resetStreamState: %" PRIu64 " frames, latency avg = %" PRId64 " us, max = %" PRId64 " us",
+                  mLatencyFrames, ns2us(mLatencySum / (nsecs_t)mLatencyFrames), ns2us(mLatencyMax));
+        }
+        mLatencyFrames = 0;
+        mLatencySum = 0;
+        mLatencyMax = 0;
+    }
+    {
+        std::lock_guard<std::mutex> lock(mDirectLock);
+
+        if (mDirectFrames || mCopiedFrames) {
+            ALOGD("resetStreamState: direct rendering, %" PRIu64 " frames without copy, %" PRIu64 " copied",
+                  mDirectFrames, mCopiedFrames);
+        }
+        mDirectFrames = 0;
+        mCopiedFrames = 0;
+    }
+}
+
 void C2FFMPEGVideoDecodeComponent::deInitDecoder() {
     ALOGD("%p deInitDecoder: %p", this, mCtx);
+    stopOutputThread();
+    stopStandbyThread();
+    resetStreamState();
+    mDegradation = false;
+    avcodec_free_context(&mFastCtx);
+    av_packet_free(&mFastStartPacket);
+    mFastStart = false;
+    mFastStartPending = false;
+    mFastStartIndex = kNoWorkIndex;
     if (mCtx) {
         if (avcodec_is_open(mCtx)) {
             avcodec_flush_buffers(mCtx);
@@ -173,13 +835,53 @@ void C2FFMPEGVideoDecodeComponent::deInitDecoder() {
         av_packet_free(&mPacket);
         mPacket = NULL;
     }
-    if (mImgConvertCtx) {
-        sws_freeContext(mImgConvertCtx);
-        mImgConvertCtx = NULL;
+    if (mThreadSession) {
+        FFmpegThreadPool::instance().destroySession(mThreadSession);
+        mThreadSession = NULL;
+    }
+    FFmpegMemoryBudget::instance().release(this);
+    mIntf->setMemoryUsage(0);
+    mCpuCount = 0;
+    mBudgetThreads = 0;
+    mBudgetOutputDelay = 0;
+    deInitBitstreamFilter();
+    mPendingConfig.clear();
+    // Buffers still referenced by frames keep the pool alive.
+    av_buffer_pool_uninit(&mFrameInfoPool);
+    for (int i = 0; i < kMaxConvertBands; i++) {
+        if (mImgConvertCtx[i]) {
+            sws_freeContext(mImgConvertCtx[i]);
+            mImgConvertCtx[i] = NULL;
+        }
     }
     mEOSSignalled = false;
     mExtradataReady = false;
-    mPendingWorkQueue.clear();
+    mWarmReset = false;
+    mWarmConfig.clear();
+    mSpeculativeOpen = false;
+    {
+        std::lock_guard<std::recursive_mutex> lock(mPendingWorkLock);
+        mPendingWorkQueue.clear();
+    }
+    {
+        std::lock_guard<std::mutex> lock(mOutputFormatLock);
+        mOutputFormat = 0;
+    }
+    mDelayShrinkCount = 0;
+    mDelayHighWater = 0;
+    mStreamInfoProbed = false;
+    mDirectRendering = false;
+    mDrawHorizBand = false;
+    mLowLatency = false;
+    {
+        std::lock_guard<std::mutex> lock(mBandLock);
+        mBandPool.reset();
+        mBandBuffers.clear();
+    }
+    {
+        std::lock_guard<std::mutex> lock(mDirectLock);
+        mDirectPool.reset();
+    }
 }
 
 c2_status_t C2FFMPEGVideoDecodeComponent::processCodecConfig(C2ReadView* inBuffer) {
@@ -189,7 +891,13 @@ c2_status_t C2FFMPEGVideoDecodeComponent::processCodecConfig(C2ReadView* inBuffe
 #if DEBUG_EXTRADATA
     ALOGD("processCodecConfig: add = %u, current = %d", add_extradata_size, orig_extradata_size);
 #endif
-    if (! mExtradataReady) {
+    if (mWarmReset) {
+        // Compared with the current one on the first packet.
+        const uint8_t* data = inBuffer->data();
+
+        mWarmConfig.insert(mWarmConfig.end(), data, data + add_extradata_size);
+    }
+    else if (! mExtradataReady) {
         mCtx->extradata_size += add_extradata_size;
         mCtx->extradata = (uint8_t *) realloc(mCtx->extradata, mCtx->extradata_size + AV_INPUT_BUFFER_PADDING_SIZE);
         if (! mCtx->extradata) {
@@ -199,6 +907,15 @@ c2_status_t C2FFMPEGVideoDecodeComponent::processCodecConfig(C2ReadView* inBuffe
         memcpy(mCtx->extradata + orig_extradata_size, inBuffer->data(), add_extradata_size);
         memset(mCtx->extradata + mCtx->extradata_size, 0, AV_INPUT_BUFFER_PADDING_SIZE);
     }
+    else if (hasCodecConfig(mCodecID)) {
+        // Parameter sets changing mid-stream, sent along with the next packet.
+        const uint8_t* data = inBuffer->data();
+
+        ALOGD("processCodecConfig: decoder is already opened, %d bytes for next packet",
+              add_extradata_size);
+        mPendingConfig.insert(mPendingConfig.end(), data, data + add_extradata_size);
+        mLateConfig.insert(mLateConfig.end(), data, data + add_extradata_size);
+    }
     else {
         ALOGW("processCodecConfig: decoder is already opened, ignoring...");
     }
@@ -206,319 +923,1798 @@ c2_status_t C2FFMPEGVideoDecodeComponent::processCodecConfig(C2ReadView* inBuffe
     return C2_OK;
 }
 
-c2_status_t C2FFMPEGVideoDecodeComponent::sendInputBuffer(
-        C2ReadView *inBuffer, int64_t timestamp) {
-    if (!mPacket) {
-        mPacket = av_packet_alloc();
-        if (!mPacket) {
-            ALOGE("sendInputBuffer: oom for video packet");
-            return C2_NO_MEMORY;
-        }
+c2_status_t C2FFMPEGVideoDecodeComponent::initBitstreamFilter(const std::string& filters) {
+    int err = av_bsf_list_parse_str(filters.c_str(), &mBsf);
+
+    if (err < 0) {
+        ALOGE("initBitstreamFilter: cannot create filters \"%s\" (%s)", filters.c_str(), av_err2str(err));
+        return C2_BAD_VALUE;
+    }
+
+    mBsfPacket = av_packet_alloc();
+    if (! mBsfPacket) {
+        ALOGE("initBitstreamFilter: oom for filtered packet");
+        return C2_NO_MEMORY;
+    }
+
+    err = avcodec_parameters_from_context(mBsf->par_in, mCtx);
+    if (err >= 0) {
+        mBsf->time_base_in = AVRational{ 1, 1000000 };
+        err = av_bsf_init(mBsf);
+    }
+    if (err < 0) {
+        ALOGE("initBitstreamFilter: cannot initialize filters \"%s\" (%s)", filters.c_str(), av_err2str(err));
+        return C2_CORRUPTED;
+    }
+
+    // Filters like h264_mp4toannexb rewrite the extradata.
+    const AVCodecParameters* par = mBsf->par_out;
+
+    if (par->extradata_size != mCtx->extradata_size ||
+            (par->extradata_size && memcmp(par->extradata, mCtx->extradata, par->extradata_size))) {
+        uint8_t* extradata = (uint8_t*)realloc(mCtx->extradata,
+                                               par->extradata_size + AV_INPUT_BUFFER_PADDING_SIZE);
+
+        if (! extradata) {
+            ALOGE("initBitstreamFilter: oom for extradata");
+            return C2_NO_MEMORY;
+        }
+        memcpy(extradata, par->extradata, par->extradata_size);
+        memset(extradata + par->extradata_size, 0, AV_INPUT_BUFFER_PADDING_SIZE);
+        mCtx->extradata = extradata;
+        mCtx->extradata_size = par->extradata_size;
+    }
+
+    ALOGD("initBitstreamFilter: filtering input with \"%s\"", filters.c_str());
+
+    return C2_OK;
+}
+
+void C2FFMPEGVideoDecodeComponent::deInitBitstreamFilter() {
+    av_bsf_free(&mBsf);
+    av_packet_free(&mBsfPacket);
+    mBsfPending = false;
+}
+
+c2_status_t C2FFMPEGVideoDecodeComponent::sendInputBuffer(
+        C2ReadView *inBuffer, uint64_t frameIndex, uint64_t timestamp) {
+    if (!mPacket) {
+        mPacket = av_packet_alloc();
+        if (!mPacket) {
+            ALOGE("sendInputBuffer: oom for video packet");
+            return C2_NO_MEMORY;
+        }
+    }
+
+    if (mBsfPending) {
+        // The input is already in the filters, resume sending their output.
+        return sendFilteredPackets();
+    }
+
+    bool prependConfig = inBuffer && ! mPendingConfig.empty() &&
+                         mCodecID != AV_CODEC_ID_H264 && mCodecID != AV_CODEC_ID_HEVC;
+
+    if (prependConfig) {
+        // These decoders pick up new headers in-band only.
+        if (av_new_packet(mPacket, mPendingConfig.size() + inBuffer->capacity()) < 0) {
+            ALOGE("sendInputBuffer: oom for video packet with codec config");
+            return C2_NO_MEMORY;
+        }
+        memcpy(mPacket->data, mPendingConfig.data(), mPendingConfig.size());
+        memcpy(mPacket->data + mPendingConfig.size(), inBuffer->data(), inBuffer->capacity());
+    } else {
+        mPacket->data = inBuffer ? const_cast<uint8_t *>(inBuffer->data()) : NULL;
+        mPacket->size = inBuffer ? inBuffer->capacity() : 0;
+    }
+    mPacket->pts = frameIndex;
+    mPacket->dts = AV_NOPTS_VALUE;
+
+#ifdef AV_CODEC_FLAG_COPY_OPAQUE
+    if (inBuffer) {
+        mPacket->opaque_ref = av_buffer_pool_get(mFrameInfoPool);
+        if (! mPacket->opaque_ref) {
+            ALOGE("sendInputBuffer: oom for frame info");
+            av_packet_unref(mPacket);
+            return C2_NO_MEMORY;
+        }
+
+        C2FFMPEGFrameInfo* info = (C2FFMPEGFrameInfo*)mPacket->opaque_ref->data;
+
+        info->frameIndex = frameIndex;
+        info->timestamp = timestamp;
+        info->inputTime = systemTime(SYSTEM_TIME_MONOTONIC);
+    }
+#else
+    (void)timestamp;
+#endif
+
+    if (inBuffer && ! mPendingConfig.empty() && ! prependConfig) {
+        // H.264 and HEVC decoders reparse the parameter sets from side data.
+        uint8_t* sideData = av_packet_new_side_data(mPacket, AV_PKT_DATA_NEW_EXTRADATA,
+                                                    mPendingConfig.size());
+
+        if (! sideData) {
+            ALOGE("sendInputBuffer: oom for new extradata");
+            av_packet_unref(mPacket);
+            return C2_NO_MEMORY;
+        }
+        memcpy(sideData, mPendingConfig.data(), mPendingConfig.size());
+    }
+
+    if (mBsf) {
+        // The filters take the packet reference.
+        int err = av_bsf_send_packet(mBsf, inBuffer ? mPacket : NULL);
+
+        if (err < 0) {
+            ALOGE("sendInputBuffer: failed to send data (%zu) to filters: %s (%08x)",
+                  inBuffer ? inBuffer->capacity() : 0, av_err2str(err), err);
+            av_packet_unref(mPacket);
+            if (inBuffer) {
+                return C2_CORRUPTED;
+            }
+            // Drain the decoder anyway.
+            avcodec_send_packet(mCtx, NULL);
+            return C2_OK;
+        }
+        return sendFilteredPackets();
+    }
+
+    int err = avcodec_send_packet(mCtx, mPacket);
+
+    if (err >= 0 && inBuffer) {
+        keepFastStartPacket(mPacket);
+    }
+    av_packet_unref(mPacket);
+
+    if (err < 0) {
+        ALOGE("sendInputBuffer: failed to send data (%zu) to decoder: %s (%08x)",
+              inBuffer ? inBuffer->capacity() : 0, av_err2str(err), err);
+        if (err == AVERROR(EAGAIN)) {
+            // Frames must be read first, notify main decoding loop.
+            ALOGD("sendInputBuffer: returning C2_BAD_STATE");
+            return C2_BAD_STATE;
+        }
+        if (inBuffer) {
+            // Rejected, nothing will be decoded from it. Don't send the
+            // error to the client, the work is completed empty. The codec
+            // config goes with the next packet.
+            return C2_CORRUPTED;
+        }
+    } else if (inBuffer) {
+        mPendingConfig.clear();
+    }
+
+    return C2_OK;
+}
+
+c2_status_t C2FFMPEGVideoDecodeComponent::sendFilteredPackets() {
+    while (true) {
+        if (! mBsfPending) {
+            int err = av_bsf_receive_packet(mBsf, mBsfPacket);
+
+            if (err == AVERROR(EAGAIN)) {
+                break;
+            }
+            if (err == AVERROR_EOF) {
+                // Everything is out, drain the decoder and make the
+                // filters usable again.
+                avcodec_send_packet(mCtx, NULL);
+                av_bsf_flush(mBsf);
+                break;
+            }
+            if (err < 0) {
+                ALOGE("sendFilteredPackets: filtering failed: %s (%08x)", av_err2str(err), err);
+                break;
+            }
+        }
+
+        int err = avcodec_send_packet(mCtx, mBsfPacket);
+
+        if (err == AVERROR(EAGAIN)) {
+            // Kept until the decoder takes it.
+            mBsfPending = true;
+            return C2_BAD_STATE;
+        }
+        if (err < 0) {
+            ALOGE("sendFilteredPackets: failed to send data (%d) to decoder: %s (%08x)",
+                  mBsfPacket->size, av_err2str(err), err);
+        } else {
+            // The codec config went along, as side data or rewritten in-band.
+            mPendingConfig.clear();
+            keepFastStartPacket(mBsfPacket);
+        }
+        mBsfPending = false;
+        av_packet_unref(mBsfPacket);
+    }
+
+    return C2_OK;
+}
+
+c2_status_t C2FFMPEGVideoDecodeComponent::receiveFrame(bool* hasPicture) {
+    int err = avcodec_receive_frame(mCtx, mFrame);
+
+    // Already output by the fast start decoder, and pictures of the packets
+    // before its key frame would now come out of order.
+    while (err == 0 && mFastStartIndex != kNoWorkIndex && getFrameIndex(mFrame) <= mFastStartIndex) {
+        if (getFrameIndex(mFrame) == mFastStartIndex) {
+            mFastStartIndex = kNoWorkIndex;
+        }
+        err = avcodec_receive_frame(mCtx, mFrame);
+    }
+    if (err == 0) {
+        // Lost by the main decoder, or the decoding has started already.
+        mFastStartIndex = kNoWorkIndex;
+        mFastStartPending = false;
+        if (mFastStartPacket) {
+            av_packet_unref(mFastStartPacket);
+        }
+    }
+
+    *hasPicture = false;
+    if (err == 0) {
+        err = ffmpeg_hwaccel_get_frame(mCtx, mFrame);
+        if (err == 0) {
+            *hasPicture = true;
+        } else {
+            ALOGE("receiveFrame: failed to receive frame from HW decoder err = %d", err);
+            // Don't send error to client, skip frame!
+        }
+    } else if (err != AVERROR(EAGAIN) && err != AVERROR_EOF) {
+        ALOGE("receiveFrame: failed to receive frame from decoder err = %d", err);
+        // Don't report error to client.
+    }
+
+    return C2_OK;
+}
+
+// Output blocks are allocated at the decoded size (including the coded
+// padding, e.g. 1088 rows for 1080p) rounded up to 16, so that gralloc can
+// choose a stride the display can scan out directly. With adaptive playback,
+// the max picture size is used instead: smaller pictures only change the
+// crop and the block pool keeps recycling the same buffers.
+void C2FFMPEGVideoDecodeComponent::getBlockSize(int width, int height,
+                                                uint32_t* blockWidth, uint32_t* blockHeight) {
+    *blockWidth = FFALIGN(std::max<uint32_t>(width, mIntf->getMaxWidth()), 16);
+    *blockHeight = FFALIGN(std::max<uint32_t>(height, mIntf->getMaxHeight()), 16);
+}
+
+// Display area of the frame.
+static C2Rect getCropRect(const AVFrame* frame) {
+    return C2Rect(frame->width - frame->crop_left - frame->crop_right,
+                  frame->height - frame->crop_top - frame->crop_bottom)
+           .at(frame->crop_left, frame->crop_top);
+}
+
+// Pointers to row y of each plane.
+static void offsetPlanes(enum AVPixelFormat format, uint8_t* const data[4], const int linesize[4],
+                         int y, uint8_t* band[4]) {
+    const AVPixFmtDescriptor* desc = av_pix_fmt_desc_get(format);
+
+    for (int i = 0; i < 4; i++) {
+        int shift = (i == 1 || i == 2) ? desc->log2_chroma_h : 0;
+        band[i] = data[i] ? data[i] + (y >> shift) * linesize[i] : NULL;
+    }
+}
+
+// Large frames are converted in horizontal bands running in parallel on the
+// shared worker pool: one band per 720p worth of pixels, up to the number
+// of available cores.
+static int getConvertBands(const AVFrame* frame) {
+    const AVPixFmtDescriptor* desc = av_pix_fmt_desc_get((AVPixelFormat)frame->format);
+    int bands = (frame->width * frame->height) / (1280 * 720);
+
+    if (! desc || (desc->flags & (AV_PIX_FMT_FLAG_PAL | AV_PIX_FMT_FLAG_BITSTREAM))) {
+        return 1;
+    }
+
+    bands = std::min(bands, FFmpegThreadPool::instance().getConcurrency());
+    return std::max(1, std::min(bands, kMaxConvertBands));
+}
+
+// Bands converted by separate scaler contexts only join without seams if
+// no plane is resampled: vertical filter taps would stop at the band edges.
+static bool canScaleInBands(enum AVPixelFormat srcFormat, enum AVPixelFormat dstFormat) {
+    const AVPixFmtDescriptor* src = av_pix_fmt_desc_get(srcFormat);
+    const AVPixFmtDescriptor* dst = av_pix_fmt_desc_get(dstFormat);
+
+    return src && dst &&
+           ! ((src->flags | dst->flags) & AV_PIX_FMT_FLAG_RGB) &&
+           src->log2_chroma_w == dst->log2_chroma_w &&
+           src->log2_chroma_h == dst->log2_chroma_h;
+}
+
+uint32_t C2FFMPEGVideoDecodeComponent::selectOutputFormat(int format) {
+    const AVPixFmtDescriptor* desc = av_pix_fmt_desc_get((AVPixelFormat)format);
+    uint32_t pixelFormat = mIntf->getPixelFormat();
+
+    // Only advertised when gralloc supports P010.
+    if (desc && desc->comp[0].depth > 8 &&
+            (pixelFormat == HAL_PIXEL_FORMAT_YCBCR_P010 ||
+             pixelFormat == HAL_PIXEL_FORMAT_IMPLEMENTATION_DEFINED)) {
+        return HAL_PIXEL_FORMAT_YCBCR_P010;
+    }
+
+    if (pixelFormat == HAL_PIXEL_FORMAT_YV12) {
+        // Explicitly requested by the client.
+        return HAL_PIXEL_FORMAT_YV12;
+    }
+
+    // Flexible YUV: pick the layout needing the fewest conversions. Gralloc
+    // lays out flexible YUV 4:2:0 as semi-planar on most platforms, which
+    // matches the output of the HW accelerated path.
+    switch (format) {
+        case AV_PIX_FMT_NV12:
+        case AV_PIX_FMT_NV21:
+        case AV_PIX_FMT_P010:
+            return HAL_PIXEL_FORMAT_YCBCR_420_888;
+        default:
+            return HAL_PIXEL_FORMAT_YV12;
+    }
+}
+
+// Maps the layout of a graphic block to an FFmpeg pixel format.
+static c2_status_t getOutputPlanes(C2GraphicView* outBuffer, uint8_t* data[4], int linesize[4],
+                                   enum AVPixelFormat* format) {
+    C2PlanarLayout layout = outBuffer->layout();
+    const C2PlaneInfo& uPlane = layout.planes[C2PlanarLayout::PLANE_U];
+    const C2PlaneInfo& vPlane = layout.planes[C2PlanarLayout::PLANE_V];
+    uint8_t* uData = outBuffer->data()[C2PlanarLayout::PLANE_U];
+    uint8_t* vData = outBuffer->data()[C2PlanarLayout::PLANE_V];
+
+    data[0] = outBuffer->data()[C2PlanarLayout::PLANE_Y];
+    linesize[0] = layout.planes[C2PlanarLayout::PLANE_Y].rowInc;
+
+    if (layout.planes[C2PlanarLayout::PLANE_Y].allocatedDepth == 16) {
+        // P010 is the only 16-bit layout requested.
+        if (uPlane.colInc == 4 && vPlane.colInc == 4 && vData == uData + 2) {
+            *format = AV_PIX_FMT_P010;
+            data[1] = uData;
+            linesize[1] = uPlane.rowInc;
+            return C2_OK;
+        }
+        ALOGE("getOutputPlanes: unsupported 16-bit output layout, colInc = %d/%d",
+              uPlane.colInc, vPlane.colInc);
+        return C2_CORRUPTED;
+    }
+
+    // Flexible blocks can be either planar or semi-planar.
+    if (uPlane.colInc == 1 && vPlane.colInc == 1) {
+        *format = AV_PIX_FMT_YUV420P;
+        data[1] = uData;
+        data[2] = vData;
+        linesize[1] = uPlane.rowInc;
+        linesize[2] = vPlane.rowInc;
+    } else if (uPlane.colInc == 2 && vPlane.colInc == 2 && vData == uData + 1) {
+        *format = AV_PIX_FMT_NV12;
+        data[1] = uData;
+        linesize[1] = uPlane.rowInc;
+    } else if (uPlane.colInc == 2 && vPlane.colInc == 2 && uData == vData + 1) {
+        *format = AV_PIX_FMT_NV21;
+        data[1] = vData;
+        linesize[1] = vPlane.rowInc;
+    } else {
+        ALOGE("getOutputPlanes: unsupported output layout, colInc = %d/%d",
+              uPlane.colInc, vPlane.colInc);
+        return C2_CORRUPTED;
+    }
+
+    return C2_OK;
+}
+
+c2_status_t C2FFMPEGVideoDecodeComponent::getOutputBuffer(AVFrame* frame, C2GraphicView* outBuffer) {
+    uint8_t* data[4];
+    int linesize[4];
+    enum AVPixelFormat dstFormat;
+    c2_status_t err = getOutputPlanes(outBuffer, data, linesize, &dstFormat);
+
+    if (err != C2_OK) {
+        return err;
+    }
+
+    return convertFrame(frame, data, linesize, dstFormat);
+}
+
+c2_status_t C2FFMPEGVideoDecodeComponent::convertFrame(
+    const AVFrame* frame, uint8_t* const data[4], const int linesize[4], enum AVPixelFormat dstFormat
+) {
+    int bands = getConvertBands(frame);
+    int bandHeight = FFALIGN((frame->height + bands - 1) / bands, 16);
+
+    bands = (frame->height + bandHeight - 1) / bandHeight;
+
+    // Same-size conversion of common formats is only moving planes around,
+    // use the dedicated kernels instead of swscale.
+    if (ffmpeg_convert_supported((AVPixelFormat)frame->format, dstFormat)) {
+        FFmpegThreadPool::instance().parallelFor(mThreadSession, bands, bands, [&](int band, int) {
+            int y = band * bandHeight;
+
+            ffmpeg_convert_slice(frame, data, linesize, dstFormat,
+                                 y, std::min(bandHeight, frame->height - y));
+        });
+        return C2_OK;
+    }
+
+    if (! canScaleInBands((AVPixelFormat)frame->format, dstFormat)) {
+        bands = 1;
+        bandHeight = frame->height;
+    }
+
+    // Each band uses its own scaler context.
+    for (int band = 0; band < bands; band++) {
+        struct SwsContext* currentImgConvertCtx = mImgConvertCtx[band];
+        int h = std::min(bandHeight, frame->height - band * bandHeight);
+
+        mImgConvertCtx[band] = sws_getCachedContext(currentImgConvertCtx,
+               frame->width, h, (AVPixelFormat)frame->format,
+               frame->width, h, dstFormat,
+               SWS_BICUBIC, NULL, NULL, NULL);
+        if (mImgConvertCtx[band] && mImgConvertCtx[band] != currentImgConvertCtx) {
+            ALOGD("convertFrame: created video converter - %s => %s, band %d/%d",
+                  av_get_pix_fmt_name((AVPixelFormat)frame->format), av_get_pix_fmt_name(dstFormat),
+                  band, bands);
+
+        } else if (! mImgConvertCtx[band]) {
+            ALOGE("convertFrame: cannot initialize the conversion context");
+            return C2_NO_MEMORY;
+        }
+    }
+
+    FFmpegThreadPool::instance().parallelFor(mThreadSession, bands, bands, [&](int band, int) {
+        int y = band * bandHeight;
+        int h = std::min(bandHeight, frame->height - y);
+        const uint8_t* srcBand[4];
+        uint8_t* dstBand[4];
+
+        offsetPlanes((AVPixelFormat)frame->format, frame->data, frame->linesize, y, (uint8_t**)srcBand);
+        offsetPlanes(dstFormat, data, linesize, y, dstBand);
+        sws_scale(mImgConvertCtx[band], srcBand, frame->linesize, 0, h, dstBand, linesize);
+    });
+
+    return C2_OK;
+}
+
+int C2FFMPEGVideoDecodeComponent::getBuffer2(AVCodecContext* ctx, AVFrame* frame, int flags) {
+    C2FFMPEGVideoDecodeComponent* thiz = (C2FFMPEGVideoDecodeComponent*)ctx->opaque;
+
+    if (thiz->getDirectBuffer(ctx, frame) == C2_OK) {
+        return 0;
+    }
+
+    // Fallback to regular buffers, the frame will be copied on output.
+    return avcodec_default_get_buffer2(ctx, frame, flags);
+}
+
+void C2FFMPEGVideoDecodeComponent::releaseDirectBuffer(void* opaque, uint8_t* /* data */) {
+    C2FFMPEGDirectBuffer* buffer = (C2FFMPEGDirectBuffer*)opaque;
+
+    {
+        std::lock_guard<std::mutex> lock(buffer->owner->mDirectLock);
+        buffer->owner->mDirectBuffers.erase(buffer);
+    }
+    delete buffer;
+}
+
+c2_status_t C2FFMPEGVideoDecodeComponent::getDirectBuffer(AVCodecContext* ctx, AVFrame* frame) {
+    static const int kPlanes[3] = {
+        C2PlanarLayout::PLANE_Y, C2PlanarLayout::PLANE_U, C2PlanarLayout::PLANE_V
+    };
+    int linesizeAlign[AV_NUM_DATA_POINTERS];
+    int width = frame->width;
+    int height = frame->height;
+    uint32_t blockWidth, blockHeight;
+    std::shared_ptr<C2GraphicBlock> block;
+    c2_status_t err;
+
+    if (frame->format != AV_PIX_FMT_YUV420P && frame->format != AV_PIX_FMT_YUVJ420P) {
+        return C2_OMITTED;
+    }
+
+    // Include the padding the codec needs around the picture.
+    avcodec_align_dimensions2(ctx, &width, &height, linesizeAlign);
+    getBlockSize(width, height, &blockWidth, &blockHeight);
+
+    // With frame threading, this is called from the decoder worker threads.
+    std::lock_guard<std::mutex> lock(mDirectLock);
+
+    if (! mDirectPool) {
+        return C2_NO_INIT;
+    }
+
+    // Blocks held by the decoder are not accounted for by the client beyond
+    // the output delay, don't take the ones the copies need.
+    if ((int)mDirectBuffers.size() >= getMaxDirectBuffers()) {
+#if DEBUG_DIRECT_RENDERING
+        ALOGD("getDirectBuffer: %zu blocks held, using a regular buffer", mDirectBuffers.size());
+#endif
+        return C2_NO_MEMORY;
+    }
+
+    err = mDirectPool->fetchGraphicBlock(blockWidth, blockHeight, HAL_PIXEL_FORMAT_YV12,
+                                         { C2MemoryUsage::CPU_READ, C2MemoryUsage::CPU_WRITE }, &block);
+    if (err != C2_OK) {
+#if DEBUG_DIRECT_RENDERING
+        ALOGD("getDirectBuffer: failed to fetch graphic block %u x %u err = %d", blockWidth, blockHeight, err);
+#endif
+        return err;
+    }
+
+    C2FFMPEGDirectBuffer* buffer = new C2FFMPEGDirectBuffer { this, block, block->map().get() };
+
+    err = buffer->view.error();
+    if (err != C2_OK) {
+        ALOGE("getDirectBuffer: graphic view map failed err = %d", err);
+        delete buffer;
+        return err;
+    }
+
+    const C2PlanarLayout& layout = buffer->view.layout();
+    uint8_t* const* data = buffer->view.data();
+
+    // The gralloc layout must satisfy the alignment constraints of the codec,
+    // otherwise let libavcodec allocate its own buffers.
+    for (int i = 0; i < 3; i++) {
+        const C2PlaneInfo& plane = layout.planes[kPlanes[i]];
+
+        if (plane.colInc != 1 ||
+                plane.rowInc % linesizeAlign[i] != 0 ||
+                (uintptr_t)data[kPlanes[i]] % linesizeAlign[i] != 0) {
+#if DEBUG_DIRECT_RENDERING
+            ALOGD("getDirectBuffer: plane %d not suitable, stride = %d, align = %d",
+                  i, plane.rowInc, linesizeAlign[i]);
+#endif
+            delete buffer;
+            return C2_BAD_VALUE;
+        }
+        frame->data[i] = data[kPlanes[i]];
+        frame->linesize[i] = plane.rowInc;
+    }
+
+    frame->buf[0] = av_buffer_create(frame->data[0], frame->linesize[0] * height,
+                                     releaseDirectBuffer, buffer, 0);
+    if (! frame->buf[0]) {
+        ALOGE("getDirectBuffer: oom for buffer reference");
+        delete buffer;
+        return C2_NO_MEMORY;
+    }
+    frame->extended_data = frame->data;
+    mDirectBuffers.insert(buffer);
+
+    return C2_OK;
+}
+
+bool C2FFMPEGVideoDecodeComponent::getDirectBlock(AVFrame* frame, std::shared_ptr<C2GraphicBlock>* block) {
+    if (! mDirectRendering || ! frame->buf[0]) {
+        return false;
+    }
+
+    C2FFMPEGDirectBuffer* buffer = (C2FFMPEGDirectBuffer*)av_buffer_get_opaque(frame->buf[0]);
+
+    std::lock_guard<std::mutex> lock(mDirectLock);
+
+    if (mDirectBuffers.count(buffer) == 0) {
+        // Allocated by libavcodec.
+        mCopiedFrames++;
+        return false;
+    }
+
+    // If the decoder (or one of its frame threads) still holds a reference,
+    // the picture may be needed for prediction after the block is returned
+    // to the pool by the consumer: copy it instead.
+    if (! av_buffer_is_writable(frame->buf[0])) {
+#if DEBUG_DIRECT_RENDERING
+        ALOGD("getDirectBlock: picture still referenced, copying");
+#endif
+        mCopiedFrames++;
+        return false;
+    }
+
+    *block = buffer->block;
+    mDirectFrames++;
+    return true;
+}
+
+void C2FFMPEGVideoDecodeComponent::drawHorizBand(
+        AVCodecContext* ctx, const AVFrame* src, int /* offset */[AV_NUM_DATA_POINTERS],
+        int y, int /* type */, int height) {
+    C2FFMPEGVideoDecodeComponent* thiz = (C2FFMPEGVideoDecodeComponent*)ctx->opaque;
+
+    thiz->convertBand(src, y, height);
+}
+
+void C2FFMPEGVideoDecodeComponent::convertBand(const AVFrame* src, int y, int height) {
+    uint32_t format = selectOutputFormat(src->format);
+    std::shared_ptr<C2FFMPEGBandBuffer> buffer;
+
+    height = std::min(height, src->height - y);
+    if (height <= 0 || (y & 1) || ! src->data[0]) {
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mBandLock);
+
+        for (auto& b : mBandBuffers) {
+            if (b->picture == src->data[0] && b->pts == src->pts) {
+                buffer = b;
+                break;
+            }
+        }
+
+        if (! buffer) {
+            std::shared_ptr<C2GraphicBlock> block;
+            uint32_t blockWidth, blockHeight;
+
+            getBlockSize(src->width, src->height, &blockWidth, &blockHeight);
+            if (! mBandPool ||
+                    mBandPool->fetchGraphicBlock(blockWidth, blockHeight, format,
+                            { C2MemoryUsage::CPU_READ, C2MemoryUsage::CPU_WRITE }, &block) != C2_OK) {
+                return;
+            }
+
+            if (mBandBuffers.size() >= kMaxBandBuffers) {
+                // Never output, e.g. skipped or dropped by a flush.
+                mBandBuffers.pop_front();
+            }
+            buffer.reset(new C2FFMPEGBandBuffer {
+                src->data[0], src->pts, src->width, src->height, format,
+                block, block->map().get(), {}, {}, AV_PIX_FMT_NONE,
+                std::vector<bool>(src->height, false), 0 });
+            mBandBuffers.push_back(buffer);
+
+            if (buffer->view.error() != C2_OK ||
+                    getOutputPlanes(&buffer->view, buffer->data, buffer->linesize, &buffer->dstFormat) != C2_OK ||
+                    ! ffmpeg_convert_supported((AVPixelFormat)src->format, buffer->dstFormat)) {
+#if DEBUG_HORIZ_BAND
+                ALOGD("convertBand: %s not supported", av_get_pix_fmt_name((AVPixelFormat)src->format));
+#endif
+                // Keep the entry so that next bands don't try again.
+                buffer->dstFormat = AV_PIX_FMT_NONE;
+            }
+        }
+
+        if (buffer->dstFormat == AV_PIX_FMT_NONE ||
+                buffer->width != src->width || buffer->height != src->height) {
+            return;
+        }
+    }
+
+    // Bands don't overlap, the conversion runs outside the lock. The
+    // reference keeps the block mapped even if the entry gets evicted.
+    ffmpeg_convert_slice(src, buffer->data, buffer->linesize, buffer->dstFormat, y, height);
+
+    std::lock_guard<std::mutex> lock(mBandLock);
+
+    for (int i = y; i < y + height; i++) {
+        if (! buffer->rows[i]) {
+            buffer->rows[i] = true;
+            buffer->rowsDone++;
+        }
+    }
+}
+
+bool C2FFMPEGVideoDecodeComponent::getBandBlock(
+        AVFrame* frame, uint32_t format, std::shared_ptr<C2GraphicBlock>* block) {
+    if (! mDrawHorizBand) {
+        return false;
+    }
+
+    std::lock_guard<std::mutex> lock(mBandLock);
+
+    for (auto it = mBandBuffers.begin(); it != mBandBuffers.end(); ++it) {
+        C2FFMPEGBandBuffer* buffer = it->get();
+
+        if (buffer->picture != frame->data[0] || buffer->pts != frame->pts) {
+            continue;
+        }
+
+        bool complete = buffer->dstFormat != AV_PIX_FMT_NONE &&
+                        buffer->rowsDone == frame->height &&
+                        buffer->width == frame->width &&
+                        buffer->format == format;
+
+#if DEBUG_HORIZ_BAND
+        ALOGD("getBandBlock: pts=%" PRId64 " rows=%d/%d%s", frame->pts,
+              buffer->rowsDone, frame->height, complete ? "" : ", converting whole frame");
+#endif
+        if (complete) {
+            *block = buffer->block;
+        }
+        mBandBuffers.erase(it);
+        return complete;
+    }
+
+    return false;
+}
+
+static void fillEmptyWork(const std::unique_ptr<C2Work>& work) {
+    work->worklets.front()->output.flags =
+        (C2FrameData::flags_t)(work->input.flags & C2FrameData::FLAG_END_OF_STREAM);
+    work->worklets.front()->output.buffers.clear();
+    work->worklets.front()->output.ordinal = work->input.ordinal;
+    work->workletsProcessed = 1u;
+    work->result = C2_OK;
+#if DEBUG_WORKQUEUE
+    ALOGD("WorkQueue: drop idx=%" PRIu64 ", ts=%" PRIu64,
+          work->input.ordinal.frameIndex.peeku(), work->input.ordinal.timestamp.peeku());
+#endif
+}
+
+// Threading of the decoder for the stream: thread count from the size and
+// format of the pictures within the CPUs usable by the process, thread type
+// from the coding tools.
+// Reading the affinity and the cgroup quota takes file I/O, not for each
+// work.
+int C2FFMPEGVideoDecodeComponent::getCpuCount() {
+    if (! mCpuCount) {
+        mCpuCount = ffmpeg_cpu_count();
+    }
+    return mCpuCount;
+}
+
+void C2FFMPEGVideoDecodeComponent::planThreading(int* threadType, int* threadCount) {
+    int cpus = std::min(getCpuCount(), kMaxThreads);
+    int threads = cpus;
+
+    *threadType = FF_THREAD_FRAME | FF_THREAD_SLICE;
+
+    if (mStreamInfoProbed) {
+        // Samples per picture, relative to 8-bit 4:2:0.
+        int64_t cost = (int64_t)mStreamInfo.width * mStreamInfo.height;
+
+        if (mStreamInfo.chroma_format == 2) {
+            cost = cost * 4 / 3;
+        } else if (mStreamInfo.chroma_format == 3) {
+            cost *= 2;
+        }
+        if (mStreamInfo.bit_depth > 8) {
+            cost = cost * 3 / 2;
+        }
+
+        // Small pictures gain nothing from many threads, while each frame
+        // thread adds a picture of delay and of memory: one thread per 360p
+        // worth of samples.
+        threads = (int)std::max<int64_t>(1, std::min<int64_t>(
+                (cost + kPixelsPerThread - 1) / kPixelsPerThread, cpus));
+
+        // Wavefronts and tiles let slice threads share a picture, without
+        // the delay of frame threads.
+        if (mStreamInfo.parallel_slices && threads > 1) {
+            *threadType = FF_THREAD_SLICE;
+        }
+    }
+
+    int forcedThreads = base::GetIntProperty("debug.ffmpeg_codec2.threads", 0);
+
+    *threadCount = forcedThreads > 0 ? forcedThreads : threads;
+    if (mBudgetThreads > 0) {
+        *threadCount = std::min(*threadCount, mBudgetThreads);
+    }
+}
+
+// Pictures a decoder typically keeps as references.
+static int getReferenceFrames(enum AVCodecID codecID) {
+    switch (codecID) {
+    case AV_CODEC_ID_H264:
+        return 4;
+    case AV_CODEC_ID_HEVC:
+        return 6;
+    case AV_CODEC_ID_VP9:
+    case AV_CODEC_ID_AV1:
+        return 8;
+    default:
+        return 2;
+    }
+}
+
+void C2FFMPEGVideoDecodeComponent::reserveMemory() {
+    FFmpegMemoryRequest request;
+    int reorderDepth = mStreamInfoProbed ? mStreamInfo.reorder_depth : -1;
+
+    request.width = mStreamInfoProbed ? mStreamInfo.width : mCtx->width;
+    request.height = mStreamInfoProbed ? mStreamInfo.height : mCtx->height;
+    request.bit_depth = mStreamInfoProbed ? mStreamInfo.bit_depth : 8;
+    request.chroma_format = mStreamInfoProbed ? mStreamInfo.chroma_format : 1;
+    request.references = getReferenceFrames(mCodecID);
+    request.threads = std::max(mCtx->thread_count, 1);
+    request.frame_threads = (mCtx->thread_type & FF_THREAD_FRAME) &&
+                            (mCtx->codec->capabilities & AV_CODEC_CAP_FRAME_THREADS);
+    request.output_delay = std::max(getTargetOutputDelay(), mIntf->getOutputDelay());
+    // The fast start decoder keeps the picture it decoded in its pool.
+    request.extra_pictures = mFastCtx ? 1 : 0;
+    // Unknown reordering: keep the delay, works would be dropped otherwise.
+    request.min_output_delay = reorderDepth >= 0 ? reorderDepth + 2 : request.output_delay;
+    request.priority = mLowLatency ? 2 : mIntf->isRealTime() ? 1 : 0;
+
+    FFmpegMemoryBudget& budget = FFmpegMemoryBudget::instance();
+    size_t limit = budget.getLimit();
+
+    // Decoders kept for reuse give way to running sessions.
+    if (limit && budget.getTotalUsage() - budget.getUsage(this) + FFmpegDecoderPool::instance().getBytes() +
+                 FFmpegMemoryBudget::getFootprint(request) > limit) {
+        FFmpegDecoderPool::instance().trim();
+    }
+
+    mIntf->setMemoryUsage(budget.reserve(this, &request) >> 10);
+
+    // Threads of an opened decoder are fixed.
+    if (! mCodecAlreadyOpened && request.threads < std::max(mCtx->thread_count, 1)) {
+        mCtx->thread_count = request.threads;
+        mBudgetThreads = request.threads;
+    }
+    if (limit) {
+        mBudgetOutputDelay = request.output_delay;
+    }
+}
+
+// Client blocks the decoder may hold at once: its references and a picture
+// per frame thread, including the one being decoded.
+int C2FFMPEGVideoDecodeComponent::getMaxDirectBuffers() {
+    int threads = (mCtx->active_thread_type & FF_THREAD_FRAME) ? std::max(mCtx->thread_count, 1) : 1;
+
+    return getReferenceFrames(mCodecID) + threads;
+}
+
+uint32_t C2FFMPEGVideoDecodeComponent::getMaxOutputDelay() {
+    return mBudgetOutputDelay ? std::min(mBudgetOutputDelay, kMaxOutputDelay) : kMaxOutputDelay;
+}
+
+uint32_t C2FFMPEGVideoDecodeComponent::getTargetOutputDelay() {
+    const AVCodec* codec;
+    int reorderDepth;
+    int threads;
+    bool frameThreads;
+
+    if (mCodecAlreadyOpened) {
+        // Pictures held back for reordering. libavcodec derives it from the
+        // sequence headers (H.264/HEVC num_reorder_frames / max_dec_frame_buffering)
+        // and raises it if the stream reorders more than announced.
+        codec = mCtx->codec;
+        reorderDepth = mCtx->has_b_frames;
+        threads = mCtx->thread_count;
+        frameThreads = mCtx->active_thread_type & FF_THREAD_FRAME;
+    } else if (mStreamInfoProbed && mStreamInfo.reorder_depth >= 0) {
+        // Not opened yet, from the probed headers and the planned threading.
+        codec = avcodec_find_decoder(mCodecID);
+        if (! codec) {
+            return mIntf->getOutputDelay();
+        }
+        reorderDepth = mStreamInfo.reorder_depth;
+        int threadType;
+
+        planThreading(&threadType, &threads);
+        frameThreads = (codec->capabilities & AV_CODEC_CAP_FRAME_THREADS) &&
+                       (threadType & FF_THREAD_FRAME) && threads > 1;
+    } else {
+        return mIntf->getOutputDelay();
+    }
+
+    uint32_t delay = std::max(reorderDepth, 0);
+
+    // References decoded into client blocks, see getMaxDirectBuffers().
+    // Frame threads are counted below.
+    if (mCodecAlreadyOpened && mDirectRendering) {
+        delay += getReferenceFrames(mCodecID);
+    }
+
+    if (mCodecAlreadyOpened ? mLowLatency : mIntf->getLowLatencyMode()) {
+        // No frame threads, and the H.264 decoder does not reorder with
+        // AV_CODEC_FLAG_LOW_DELAY. Only the picture being output.
+        if (! mCodecAlreadyOpened && mCodecID == AV_CODEC_ID_H264) {
+            delay = 0;
+        }
+        if (codec->capabilities & AV_CODEC_CAP_OTHER_THREADS) {
+            delay += 1;
+        }
+        return std::min(delay + 1u, getMaxOutputDelay());
+    }
+
+    // Each frame thread keeps a picture in flight.
+    if (frameThreads) {
+        delay += std::max(threads - 1, 0);
+    } else if (codec->capabilities & AV_CODEC_CAP_OTHER_THREADS) {
+        // Wrapped libraries (libdav1d) pipeline about sqrt(threads) frames.
+        if (threads <= 0) {
+            threads = getCpuCount();
+        }
+        delay += std::min((int)std::ceil(std::sqrt((double)threads)), 8);
+    }
+
+    // Pictures waiting for the output thread.
+    if (mOutputQueue) {
+        delay += kOutputQueueSize;
+    }
+
+    // The picture being output, plus one for packets decoding to nothing.
+    return std::min(delay + 2u, getMaxOutputDelay());
+}
+
+void C2FFMPEGVideoDecodeComponent::probeStreamInfo(
+    const uint8_t* data, int size,
+    const std::unique_ptr<C2Work>& work
+) {
+    FFmpegStreamInfo info;
+
+    if (! ffmpeg_probe_stream_info(mCodecID, data, size, &info)) {
+        return;
+    }
+
+    ALOGD("probeStreamInfo: %d x %d, depth = %d, chroma = %d, reorder = %d",
+          info.width, info.height, info.bit_depth, info.chroma_format, info.reorder_depth);
+
+    std::vector<std::unique_ptr<C2Param>> configUpdate;
+
+    mStreamInfo = info;
+    mStreamInfoProbed = true;
+
+    // Announce what the first frame would, so that it does not trigger a
+    // reconfiguration. The decoder checks the values again on output. An
+    // upper bound is left to the first frame, the memory budget reserves it.
+    if (! info.size_is_max &&
+            ((uint32_t)info.width != mIntf->getWidth() || (uint32_t)info.height != mIntf->getHeight())) {
+        if (updatePictureSize(info.width, info.height, &configUpdate) == C2_OK) {
+            mCtx->width = info.width;
+            mCtx->height = info.height;
+        }
+    }
+    updateOutputFormat(info.bit_depth > 8 ? AV_PIX_FMT_YUV420P10 : AV_PIX_FMT_YUV420P, &configUpdate);
+
+    uint32_t outputDelay = getTargetOutputDelay();
+
+    if (outputDelay != mIntf->getOutputDelay() && setOutputDelay(outputDelay, &configUpdate)) {
+        ALOGD("probeStreamInfo: output delay set to %u", outputDelay);
+    }
+
+    // Probed from the first packet (VP9) the work waits for its picture,
+    // the framework must not wait for it.
+    sendConfigUpdate(work, configUpdate);
+}
+
+bool C2FFMPEGVideoDecodeComponent::setOutputDelay(
+    uint32_t outputDelay,
+    std::vector<std::unique_ptr<C2Param>>* configUpdate
+) {
+    C2PortActualDelayTuning::output delay(outputDelay);
+    std::vector<std::unique_ptr<C2SettingResult>> failures;
+    c2_status_t err = mIntf->config({ &delay }, C2_MAY_BLOCK, &failures);
+
+    if (err != C2_OK) {
+        ALOGE("WorkQueue: output delay update to %u failed err = %d", outputDelay, err);
+        return false;
+    }
+    configUpdate->push_back(C2Param::Copy(delay));
+    return true;
+}
+
+// Config updates only reach the framework with a completed work, while the
+// component already applies them. A work waiting for its picture would carry
+// them late: send them on an incomplete copy of it, handled right away.
+void C2FFMPEGVideoDecodeComponent::sendConfigUpdate(
+    const std::unique_ptr<C2Work>& work,
+    std::vector<std::unique_ptr<C2Param>>& configUpdate
+) {
+    if (configUpdate.empty()) {
+        return;
+    }
+
+    if (work->workletsProcessed != 0u) {
+        // Completed on return from process().
+        std::move(configUpdate.begin(), configUpdate.end(),
+                  std::back_inserter(work->worklets.front()->output.configUpdate));
+        configUpdate.clear();
+        return;
+    }
+
+    auto fillConfigUpdate = [&configUpdate](const std::unique_ptr<C2Work>& clone) {
+        clone->worklets.front()->output.flags = C2FrameData::FLAG_INCOMPLETE;
+        clone->worklets.front()->output.ordinal = clone->input.ordinal;
+        clone->worklets.front()->output.configUpdate = std::move(configUpdate);
+        clone->workletsProcessed = 1u;
+        clone->result = C2_OK;
+    };
+
+    cloneAndSend(work->input.ordinal.frameIndex.peeku(), work, fillConfigUpdate);
+    configUpdate.clear();
+}
+
+void C2FFMPEGVideoDecodeComponent::updateOutputDelay(const std::unique_ptr<C2Work>& work) {
+    uint32_t outputDelay = mIntf->getOutputDelay();
+    uint32_t targetDelay = getTargetOutputDelay();
+    std::vector<std::unique_ptr<C2Param>> configUpdate;
+
+    if (targetDelay > outputDelay) {
+        // Grow right away, works would be dropped otherwise.
+        if (setOutputDelay(targetDelay, &configUpdate)) {
+            ALOGD("WorkQueue: reorder depth increased, output delay %u => %u",
+                  outputDelay, targetDelay);
+        }
+        sendConfigUpdate(work, configUpdate);
+        mDelayShrinkCount = 0;
+        mDelayHighWater = 0;
+        return;
+    }
+
+    // Shrink only once the reorder depth and the pending queue stayed well
+    // below the delay for a while, and never below what the queue needed.
+    // In low latency mode the delay is the point, shrink right away.
+    targetDelay = std::max(targetDelay, mDelayHighWater + 1u);
+    if (targetDelay >= outputDelay ||
+            (! mLowLatency && targetDelay + kOutputDelayShrinkMargin > outputDelay)) {
+        mDelayShrinkCount = 0;
+        mDelayHighWater = 0;
+        return;
+    }
+    if (++mDelayShrinkCount < kOutputDelayShrinkWorks && ! mLowLatency) {
+        return;
+    }
+
+    if (setOutputDelay(targetDelay, &configUpdate)) {
+        ALOGD("WorkQueue: output delay %u => %u", outputDelay, targetDelay);
+    }
+    sendConfigUpdate(work, configUpdate);
+    mDelayShrinkCount = 0;
+    mDelayHighWater = 0;
+}
+
+void C2FFMPEGVideoDecodeComponent::pushPendingWork(const std::unique_ptr<C2Work>& work) {
+    std::lock_guard<std::recursive_mutex> lock(mPendingWorkLock);
+    uint32_t outputDelay = mIntf->getOutputDelay();
+
+    if (mPendingWorkQueue.size() >= outputDelay) {
+        // More works pending than expected from the decoder state: grow
+        // step-wise (8, 18, 34) and complete the oldest one.
+        uint32_t newOutputDelay = std::min(
+                std::max(2u * outputDelay + 2u, getTargetOutputDelay()), getMaxOutputDelay());
+        std::vector<std::unique_ptr<C2Param>> configUpdate;
+
+        if (newOutputDelay != outputDelay && setOutputDelay(newOutputDelay, &configUpdate)) {
+            ALOGD("WorkQueue: queue full, output delay set to %u", newOutputDelay);
+        }
+        mDelayShrinkCount = 0;
+
+        auto fillEmptyWorkWithConfigUpdate = [&configUpdate](const std::unique_ptr<C2Work>& work) {
+            fillEmptyWork(work);
+            // Keep the updates already attached to the work.
+            std::move(configUpdate.begin(), configUpdate.end(),
+                      std::back_inserter(work->worklets.front()->output.configUpdate));
+            configUpdate.clear();
+        };
+
+        finish(mPendingWorkQueue.popFront(), fillEmptyWorkWithConfigUpdate);
+    }
+#if DEBUG_WORKQUEUE
+    ALOGD("WorkQueue: push idx=%" PRIu64 ", ts=%" PRIu64,
+          work->input.ordinal.frameIndex.peeku(), work->input.ordinal.timestamp.peeku());
+#endif
+    mPendingWorkQueue.push(work->input.ordinal.frameIndex.peeku(),
+                           work->input.ordinal.timestamp.peeku());
+    mDelayHighWater = std::max(mDelayHighWater, (uint32_t)mPendingWorkQueue.size());
+}
+
+void C2FFMPEGVideoDecodeComponent::popPendingWork(const std::unique_ptr<C2Work>& work) {
+    std::lock_guard<std::recursive_mutex> lock(mPendingWorkLock);
+#if DEBUG_WORKQUEUE
+    ALOGD("WorkQueue: pop idx=%" PRIu64 ", ts=%" PRIu64,
+          work->input.ordinal.frameIndex.peeku(), work->input.ordinal.timestamp.peeku());
+#endif
+
+    if (! mPendingWorkQueue.erase(work->input.ordinal.frameIndex.peeku())) {
+#if DEBUG_WORKQUEUE
+        ALOGD("WorkQueue: pop work not found idx=%" PRIu64 ", ts=%" PRIu64,
+              work->input.ordinal.frameIndex.peeku(), work->input.ordinal.timestamp.peeku());
+#endif
+    }
+    prunePendingWorksUntil(work);
+}
+
+void C2FFMPEGVideoDecodeComponent::prunePendingWorksUntil(const std::unique_ptr<C2Work>& work) {
+    std::lock_guard<std::recursive_mutex> lock(mPendingWorkLock);
+#if DEBUG_WORKQUEUE
+    ALOGD("WorkQueue: prune until idx=%" PRIu64 ", ts=%" PRIu64,
+          work->input.ordinal.frameIndex.peeku(), work->input.ordinal.timestamp.peeku());
+#endif
+    // Drop all works with a PTS earlier than provided argument.
+    while (! mPendingWorkQueue.empty() &&
+           mPendingWorkQueue.frontTimestamp() < work->input.ordinal.timestamp.peeku()) {
+        finish(mPendingWorkQueue.popFront(), fillEmptyWork);
+    }
+}
+
+c2_status_t C2FFMPEGVideoDecodeComponent::onInit() {
+    ALOGD("onInit");
+    mBackgroundOpen = base::GetBoolProperty("persist.ffmpeg_codec2.background_open", false);
+    if (! mCtx && adoptDecoder()) {
+        return C2_OK;
+    }
+
+    c2_status_t err = initDecoder();
+
+    // Nothing to wait for without codec config, unless the stream info and
+    // the threads of the decoder come from probing the first packet (VP9).
+    if (err == C2_OK && ! hasCodecConfig(mCodecID) && ! ffmpeg_can_probe_stream_info(mCodecID)) {
+        startBackgroundOpen();
+    }
+    return err;
+}
+
+c2_status_t C2FFMPEGVideoDecodeComponent::onStop() {
+    ALOGD("onStop");
+    waitBackgroundOpen();
+    flushOutputStage();
+    return C2_OK;
+}
+
+void C2FFMPEGVideoDecodeComponent::onReset() {
+    ALOGD("onReset");
+    waitBackgroundOpen();
+    if (mCodecAlreadyOpened && base::GetBoolProperty("persist.ffmpeg_codec2.warm_reset", false)) {
+        warmReset();
+        return;
+    }
+    deInitDecoder();
+    initDecoder();
+}
+
+// Next session, most likely the same stream format (playlists): keep the
+// decoder open and only drop what belongs to the previous session. The
+// first packet tells whether it can really be reused.
+void C2FFMPEGVideoDecodeComponent::warmReset() {
+    ALOGD("warmReset: keeping decoder(%s) open", avcodec_get_name(mCtx->codec_id));
+    flushOutputStage();
+    {
+        std::lock_guard<std::mutex> lock(mBandLock);
+        mBandPool.reset();
+        mBandBuffers.clear();
+    }
+    {
+        std::lock_guard<std::mutex> lock(mDirectLock);
+        mDirectPool.reset();
+    }
+    avcodec_flush_buffers(mCtx);
+    if (mBsf) {
+        av_bsf_flush(mBsf);
+        av_packet_unref(mBsfPacket);
+        mBsfPending = false;
+    }
+    {
+        std::lock_guard<std::recursive_mutex> lock(mPendingWorkLock);
+        mPendingWorkQueue.clear();
+    }
+    mPendingConfig.clear();
+    mEOSSignalled = false;
+    {
+        // Announced again with the first frame.
+        std::lock_guard<std::mutex> lock(mOutputFormatLock);
+        mOutputFormat = 0;
+    }
+    mDelayShrinkCount = 0;
+    mDelayHighWater = 0;
+    resetFastStart();
+    mWarmConfig.clear();
+    mSpeculativeOpen = false;
+    resetStreamState();
+    mWarmReset = true;
+}
+
+c2_status_t C2FFMPEGVideoDecodeComponent::finishWarmReset(
+    const std::unique_ptr<C2Work>& work
+) {
+    std::vector<uint8_t> config = std::move(mWarmConfig);
+
+    mWarmReset = false;
+    mWarmConfig.clear();
+
+    if (config.empty() ||
+            (config.size() == (size_t)mCtx->extradata_size &&
+             memcmp(config.data(), mCtx->extradata, config.size()) == 0)) {
+        if (mIntf->getLowLatencyMode() == mLowLatency) {
+            ALOGD("finishWarmReset: same codec config, decoder reused");
+            if (! config.empty()) {
+                // An adopted decoder comes with a new interface.
+                probeStreamInfo(config.data(), config.size(), work);
+            }
+            return C2_OK;
+        }
+    } else {
+        // Different parameter sets of the same format are passed in-band.
+        FFmpegStreamInfo info;
+
+        if (hasCodecConfig(mCodecID) && mStreamInfoProbed && mIntf->getLowLatencyMode() == mLowLatency &&
+                ffmpeg_probe_stream_info(mCodecID, config.data(), config.size(), &info) &&
+                info.width == mStreamInfo.width && info.height == mStreamInfo.height &&
+                info.bit_depth == mStreamInfo.bit_depth &&
+                info.chroma_format == mStreamInfo.chroma_format &&
+                info.reorder_depth <= mStreamInfo.reorder_depth) {
+            ALOGD("finishWarmReset: new codec config, decoder reused");
+            probeStreamInfo(config.data(), config.size(), work);
+            mLateConfig.insert(mLateConfig.end(), config.begin(), config.end());
+            mPendingConfig = std::move(config);
+            return C2_OK;
+        }
+    }
+
+    ALOGD("finishWarmReset: codec parameters changed, reopening decoder");
+    deInitDecoder();
+
+    c2_status_t err = initDecoder();
+
+    if (err != C2_OK) {
+        return err;
+    }
+    if (! config.empty()) {
+        err = setExtradata(config.data(), config.size());
+        if (err != C2_OK) {
+            return err;
+        }
+        probeStreamInfo(mCtx->extradata, mCtx->extradata_size, work);
+    }
+    return C2_OK;
+}
+
+c2_status_t C2FFMPEGVideoDecodeComponent::setExtradata(const uint8_t* data, size_t size) {
+    mCtx->extradata = (uint8_t*)malloc(size + AV_INPUT_BUFFER_PADDING_SIZE);
+    if (! mCtx->extradata) {
+        ALOGE("setExtradata: oom for extradata");
+        return C2_NO_MEMORY;
+    }
+    memcpy(mCtx->extradata, data, size);
+    memset(mCtx->extradata + size, 0, AV_INPUT_BUFFER_PADDING_SIZE);
+    mCtx->extradata_size = size;
+    return C2_OK;
+}
+
+// Opens the decoder while the client prepares the first packet. Only the
+// work thread touches the decoder, and it waits for the helper thread first.
+void C2FFMPEGVideoDecodeComponent::startBackgroundOpen() {
+    if (! mBackgroundOpen || mOpenThread.joinable() || mCodecAlreadyOpened || mWarmReset) {
+        return;
+    }
+
+    ALOGD("startBackgroundOpen: opening decoder(%s) ahead of the first packet",
+          avcodec_get_name(mCodecID));
+    mOpenThread = std::thread([this] { mOpenResult = openDecoder(); });
+}
+
+void C2FFMPEGVideoDecodeComponent::waitBackgroundOpen() {
+    if (! mOpenThread.joinable()) {
+        return;
+    }
+
+    mOpenThread.join();
+    if (mOpenResult == C2_OK) {
+        mSpeculativeOpen = true;
+        return;
+    }
+
+    // The first packet opens it again, and reports the error.
+    ALOGE("waitBackgroundOpen: failed to open decoder, err = %d", mOpenResult);
+    closeSpeculativeDecoder();
+}
+
+// Back to a closed decoder, with the codec config and stream properties
+// received so far.
+void C2FFMPEGVideoDecodeComponent::closeSpeculativeDecoder() {
+    std::vector<uint8_t> extradata(mCtx->extradata, mCtx->extradata + mCtx->extradata_size);
+    FFmpegStreamInfo info = mStreamInfo;
+    bool probed = mStreamInfoProbed;
+
+    deInitDecoder();
+    if (initDecoder() != C2_OK) {
+        return;
+    }
+    if (! extradata.empty() && setExtradata(extradata.data(), extradata.size()) != C2_OK) {
+        return;
+    }
+    mStreamInfo = info;
+    mStreamInfoProbed = probed;
+}
+
+// Takes a decoder released by another component. Whether it suits the
+// stream is only known from the first packet, as after a warm reset.
+bool C2FFMPEGVideoDecodeComponent::adoptDecoder() {
+    FFmpegDecoderPool& decoderPool = FFmpegDecoderPool::instance();
+    FFmpegPooledDecoder decoder;
+
+    if (decoderPool.getCapacity() == 0) {
+        return false;
+    }
+    if (! decoderPool.take(mCodecID, &decoder)) {
+        ALOGD("adoptDecoder: none available, hits = %" PRIu64 ", misses = %" PRIu64,
+              decoderPool.getHits(), decoderPool.getMisses());
+        return false;
+    }
+
+    // The decoder comes with its FFmpeg reference.
+    if (mFFMPEGInitialized) {
+        deInitFFmpeg();
+    }
+    mFFMPEGInitialized = true;
+    mCtx = decoder.ctx;
+    mCodecAlreadyOpened = true;
+    mExtradataReady = true;
+    mStreamInfo = decoder.stream_info;
+    mStreamInfoProbed = decoder.stream_info_probed;
+    mLowLatency = decoder.low_latency;
+    // Options of this component, e.g. debug.ffmpeg_codec2.fast.
+    applyDegradation(mCtx);
+
+    ALOGD("adoptDecoder: %p [%s], hits = %" PRIu64 ", misses = %" PRIu64,
+          mCtx, avcodec_get_name(mCodecID), decoderPool.getHits(), decoderPool.getMisses());
+
+    reserveMemory();
+    if (attachDecoder() != C2_OK) {
+        deInitDecoder();
+        return false;
+    }
+    mWarmReset = true;
+    return true;
+}
+
+// Hands the opened decoder over to the pool, for the next component of the
+// same codec.
+void C2FFMPEGVideoDecodeComponent::recycleDecoder() {
+    // Direct buffers point back to this component, and filters may have
+    // rewritten the extradata.
+    if (! mCodecAlreadyOpened || mDirectRendering || mBsf ||
+            FFmpegDecoderPool::instance().getCapacity() == 0) {
+        return;
+    }
+
+    stopOutputThread();
+    avcodec_flush_buffers(mCtx);
+    mCtx->opaque = NULL;
+    mCtx->draw_horiz_band = NULL;
+    // The next component starts at full quality.
+    if (mDegradationLevel) {
+        setDegradationLevel(0, NULL);
+    }
+    // Only the decoder is pooled, count it alone.
+    if (mFastCtx) {
+        avcodec_free_context(&mFastCtx);
+        reserveMemory();
+    }
+
+    FFmpegPooledDecoder decoder;
+
+    decoder.ctx = mCtx;
+    decoder.stream_info = mStreamInfo;
+    decoder.stream_info_probed = mStreamInfoProbed;
+    decoder.low_latency = mLowLatency;
+    decoder.bytes = FFmpegMemoryBudget::instance().getUsage(this);
+    FFmpegMemoryBudget::instance().release(this);
+    mIntf->setMemoryUsage(0);
+
+    // The pool frees the decoder, and our FFmpeg reference with it.
+    mCtx = NULL;
+    mCodecAlreadyOpened = false;
+    mFFMPEGInitialized = false;
+    FFmpegDecoderPool::instance().put(decoder);
+}
+
+void C2FFMPEGVideoDecodeComponent::onRelease() {
+    ALOGD("onRelease");
+    waitBackgroundOpen();
+    recycleDecoder();
+    deInitDecoder();
+    if (mFFMPEGInitialized) {
+        deInitFFmpeg();
+        mFFMPEGInitialized = false;
+    }
+}
+
+c2_status_t C2FFMPEGVideoDecodeComponent::onFlush_sm() {
+    ALOGD("onFlush_sm");
+    waitBackgroundOpen();
+    flushOutputStage();
+    {
+        std::lock_guard<std::mutex> lock(mBandLock);
+        mBandBuffers.clear();
+    }
+    if (mCtx && avcodec_is_open(mCtx)) {
+        // Make sure that the next buffer output does not still
+        // depend on fragments from the last one decoded.
+        if (! mStandbyThread.joinable() || ! swapStandbyDecoder()) {
+            avcodec_flush_buffers(mCtx);
+        }
+        mEOSSignalled = false;
+    }
+    // Seeking, get the first picture out fast again.
+    resetFastStart();
+    if (mBsf) {
+        av_bsf_flush(mBsf);
+        av_packet_unref(mBsfPacket);
+        mBsfPending = false;
+    }
+    return C2_OK;
+}
+
+void C2FFMPEGVideoDecodeComponent::recordLatency(const AVFrame* frame) {
+#ifdef AV_CODEC_FLAG_COPY_OPAQUE
+    if (! frame->opaque_ref) {
+        return;
+    }
+
+    const C2FFMPEGFrameInfo* info = (const C2FFMPEGFrameInfo*)frame->opaque_ref->data;
+    nsecs_t latency = systemTime(SYSTEM_TIME_MONOTONIC) - info->inputTime;
+
+#if DEBUG_LATENCY
+    ALOGD("recordLatency: idx=%" PRIu64 ", latency = %" PRId64 " us", info->frameIndex, ns2us(latency));
+#endif
+
+    std::lock_guard<std::mutex> lock(mLatencyLock);
+
+    mLatencyFrames++;
+    mLatencySum += latency;
+    mLatencyMax = std::max(mLatencyMax, latency);
+#else
+    (void)frame;
+#endif
+}
+
+static void fillOutputWork(const std::unique_ptr<C2Work>& work, c2_status_t result,
+                           const std::shared_ptr<C2Buffer>& buffer,
+                           std::vector<std::unique_ptr<C2Param>>& configUpdate) {
+    // Keep the updates already attached to the work (output delay).
+    std::move(configUpdate.begin(), configUpdate.end(),
+              std::back_inserter(work->worklets.front()->output.configUpdate));
+    configUpdate.clear();
+    work->worklets.front()->output.buffers.clear();
+    if (buffer) {
+        work->worklets.front()->output.buffers.push_back(buffer);
+    }
+    work->worklets.front()->output.ordinal = work->input.ordinal;
+    work->workletsProcessed = 1u;
+    work->result = result;
+}
+
+c2_status_t C2FFMPEGVideoDecodeComponent::updatePictureSize(
+    uint32_t width, uint32_t height,
+    std::vector<std::unique_ptr<C2Param>>* configUpdate
+) {
+    C2StreamPictureSizeInfo::output size(0u, width, height);
+    std::vector<std::unique_ptr<C2SettingResult>> failures;
+    c2_status_t err = mIntf->config({ &size }, C2_MAY_BLOCK, &failures);
+
+    if (err != C2_OK) {
+        ALOGE("updatePictureSize: config update to %u x %u failed err = %d", width, height, err);
+        return C2_CORRUPTED;
+    }
+    configUpdate->push_back(C2Param::Copy(size));
+    return C2_OK;
+}
+
+uint32_t C2FFMPEGVideoDecodeComponent::updateOutputFormat(
+    int format,
+    std::vector<std::unique_ptr<C2Param>>* configUpdate
+) {
+    uint32_t pixelFormat = selectOutputFormat(format);
+    std::lock_guard<std::mutex> lock(mOutputFormatLock);
+
+    if (pixelFormat == mOutputFormat) {
+        return pixelFormat;
     }
 
-    mPacket->data = inBuffer ? const_cast<uint8_t *>(inBuffer->data()) : NULL;
-    mPacket->size = inBuffer ? inBuffer->capacity() : 0;
-    mPacket->pts = timestamp;
-    mPacket->dts = AV_NOPTS_VALUE;
+    uint32_t bitDepth = (pixelFormat == HAL_PIXEL_FORMAT_YCBCR_P010) ? 10u : 8u;
 
-    int err = avcodec_send_packet(mCtx, mPacket);
-    av_packet_unref(mPacket);
+    ALOGD("updateOutputFormat: output pixel format %x => %x", mOutputFormat, pixelFormat);
 
-    if (err < 0) {
-        ALOGE("sendInputBuffer: failed to send data (%d) to decoder: %s (%08x)",
-              inBuffer->capacity(), av_err2str(err), err);
-        if (err == AVERROR(EAGAIN)) {
-            // Frames must be read first, notify main decoding loop.
-            ALOGD("sendInputBuffer: returning C2_BAD_STATE");
-            return C2_BAD_STATE;
+    mOutputFormat = pixelFormat;
+    configUpdate->push_back(std::make_unique<C2StreamPixelFormatInfo::output>(0u, pixelFormat));
+
+    if (bitDepth != mIntf->getBitDepth()) {
+        std::unique_ptr<C2StreamColorInfo::output> colorInfo =
+            C2StreamColorInfo::output::AllocUnique(
+                    { C2ChromaOffsetStruct::ITU_YUV_420_0() },
+                    0u, bitDepth, C2Color::YUV_420);
+        std::vector<std::unique_ptr<C2SettingResult>> failures;
+        c2_status_t err = mIntf->config({ colorInfo.get() }, C2_MAY_BLOCK, &failures);
+
+        if (err == C2_OK) {
+            configUpdate->push_back(std::move(colorInfo));
+        } else {
+            ALOGE("updateOutputFormat: bit depth update to %u failed err = %d", bitDepth, err);
         }
-        // Otherwise don't send error to client.
     }
 
-    return C2_OK;
+    return pixelFormat;
 }
 
-c2_status_t C2FFMPEGVideoDecodeComponent::receiveFrame(bool* hasPicture) {
-    int err = avcodec_receive_frame(mCtx, mFrame);
+c2_status_t C2FFMPEGVideoDecodeComponent::renderFrame(
+    AVFrame* frame,
+    const std::shared_ptr<C2BlockPool> &pool,
+    std::shared_ptr<C2Buffer>* buffer,
+    std::vector<std::unique_ptr<C2Param>>* configUpdate
+) {
+    c2_status_t err;
 
-    *hasPicture = false;
-    if (err == 0) {
-        err = ffmpeg_hwaccel_get_frame(mCtx, mFrame);
-        if (err == 0) {
-            *hasPicture = true;
-        } else {
-            ALOGE("receiveFrame: failed to receive frame from HW decoder err = %d", err);
-            // Don't send error to client, skip frame!
+#if DEBUG_FRAMES
+    ALOGD("outputFrame: pts=%" PRId64 " dts=%" PRId64 " ts=%" PRId64 " - %d x %d (%x)",
+          frame->pts, frame->pkt_dts, frame->best_effort_timestamp, frame->width, frame->height, frame->format);
+#endif
+
+    C2Rect crop = getCropRect(frame);
+
+    if (crop.width != mIntf->getWidth() || crop.height != mIntf->getHeight()) {
+        ALOGD("outputFrame: video params changed - %d x %d (%x), crop %u x %u @ %u, %u",
+              frame->width, frame->height, frame->format, crop.width, crop.height, crop.left, crop.top);
+
+        err = updatePictureSize(crop.width, crop.height, configUpdate);
+        if (err != C2_OK) {
+            return err;
         }
-    } else if (err != AVERROR(EAGAIN) && err != AVERROR_EOF) {
-        ALOGE("receiveFrame: failed to receive frame from decoder err = %d", err);
-        // Don't report error to client.
     }
 
+    uint32_t format = updateOutputFormat(frame->format, configUpdate);
+
+    std::shared_ptr<C2GraphicBlock> block;
+
+    if (format == HAL_PIXEL_FORMAT_YV12 && getDirectBlock(frame, &block)) {
+        // Decoded in place, nothing to convert.
+        err = C2_OK;
+    } else if (getBandBlock(frame, format, &block)) {
+        // Converted band by band while decoding.
+        err = C2_OK;
+    } else {
+        uint32_t blockWidth, blockHeight;
+
+        getBlockSize(frame->width, frame->height, &blockWidth, &blockHeight);
+        err = pool->fetchGraphicBlock(blockWidth, blockHeight, format,
+                                      { C2MemoryUsage::CPU_READ, C2MemoryUsage::CPU_WRITE }, &block);
+
+        if (err != C2_OK) {
+            ALOGE("outputFrame: failed to fetch graphic block %u x %u (%x) err = %d",
+                  blockWidth, blockHeight, format, err);
+            return C2_CORRUPTED;
+        }
+
+        C2GraphicView wView = block->map().get();
+
+        err = wView.error();
+        if (err != C2_OK) {
+            ALOGE("outputFrame: graphic view map failed err = %d", err);
+            return C2_CORRUPTED;
+        }
+
+        err = getOutputBuffer(frame, &wView);
+    }
+
+    if (err != C2_OK) {
+        return err;
+    }
+
+    *buffer = createGraphicBuffer(std::move(block), crop);
+    (*buffer)->setInfo(std::make_shared<C2StreamPixelFormatInfo::output>(0u, format));
+
     return C2_OK;
 }
 
-c2_status_t C2FFMPEGVideoDecodeComponent::getOutputBuffer(C2GraphicView* outBuffer) {
-    uint8_t* data[4];
-    int linesize[4];
-    C2PlanarLayout layout = outBuffer->layout();
-    struct SwsContext* currentImgConvertCtx = mImgConvertCtx;
+void C2FFMPEGVideoDecodeComponent::finishOutput(
+    uint64_t index, c2_status_t result,
+    const std::shared_ptr<C2Buffer>& buffer,
+    std::vector<std::unique_ptr<C2Param>>& configUpdate
+) {
+    auto fillWork = [result, buffer, &configUpdate, this](const std::unique_ptr<C2Work>& work) {
+        popPendingWork(work);
+        fillOutputWork(work, result, buffer, configUpdate);
+        work->worklets.front()->output.flags = (C2FrameData::flags_t)0;
+#if DEBUG_FRAMES
+        ALOGD("outputFrame: work(finish) idx=%" PRIu64 ", processed=%u, result=%d",
+              work->input.ordinal.frameIndex.peeku(), work->workletsProcessed, work->result);
+#endif
+    };
 
-    data[0] = outBuffer->data()[C2PlanarLayout::PLANE_Y];
-    data[1] = outBuffer->data()[C2PlanarLayout::PLANE_U];
-    data[2] = outBuffer->data()[C2PlanarLayout::PLANE_V];
-    linesize[0] = layout.planes[C2PlanarLayout::PLANE_Y].rowInc;
-    linesize[1] = layout.planes[C2PlanarLayout::PLANE_U].rowInc;
-    linesize[2] = layout.planes[C2PlanarLayout::PLANE_V].rowInc;
-
-    mImgConvertCtx = sws_getCachedContext(currentImgConvertCtx,
-           mFrame->width, mFrame->height, (AVPixelFormat)mFrame->format,
-           mFrame->width, mFrame->height, AV_PIX_FMT_YUV420P,
-           SWS_BICUBIC, NULL, NULL, NULL);
-    if (mImgConvertCtx && mImgConvertCtx != currentImgConvertCtx) {
-        ALOGD("getOutputBuffer: created video converter - %s => %s",
-              av_get_pix_fmt_name((AVPixelFormat)mFrame->format), av_get_pix_fmt_name(AV_PIX_FMT_YUV420P));
-
-    } else if (! mImgConvertCtx) {
-        ALOGE("getOutputBuffer: cannot initialize the conversion context");
-        return C2_NO_MEMORY;
+    finish(index, fillWork);
+}
+
+c2_status_t C2FFMPEGVideoDecodeComponent::outputFrame(
+    const std::unique_ptr<C2Work>& work,
+    const std::shared_ptr<C2BlockPool> &pool
+) {
+    std::shared_ptr<C2Buffer> buffer;
+    std::vector<std::unique_ptr<C2Param>> configUpdate;
+    c2_status_t err = renderFrame(mFrame, pool, &buffer, &configUpdate);
+
+    if (err != C2_OK) {
+        return err;
     }
 
-    sws_scale(mImgConvertCtx, mFrame->data, mFrame->linesize,
-              0, mFrame->height, data, linesize);
+    uint64_t index = getFrameIndex(mFrame);
+
+    recordLatency(mFrame);
+    if (work && c2_cntr64_t(index) == work->input.ordinal.frameIndex) {
+        prunePendingWorksUntil(work);
+        fillOutputWork(work, C2_OK, buffer, configUpdate);
+    } else {
+        finishOutput(index, C2_OK, buffer, configUpdate);
+    }
 
     return C2_OK;
 }
 
-static void fillEmptyWork(const std::unique_ptr<C2Work>& work) {
-    work->worklets.front()->output.flags =
-        (C2FrameData::flags_t)(work->input.flags & C2FrameData::FLAG_END_OF_STREAM);
-    work->worklets.front()->output.buffers.clear();
-    work->worklets.front()->output.ordinal = work->input.ordinal;
-    work->workletsProcessed = 1u;
-    work->result = C2_OK;
-#if DEBUG_WORKQUEUE
-    ALOGD("WorkQueue: drop idx=%" PRIu64 ", ts=%" PRIu64,
-          work->input.ordinal.frameIndex.peeku(), work->input.ordinal.timestamp.peeku());
-#endif
+void C2FFMPEGVideoDecodeComponent::startOutputThread() {
+    mOutputQueue = std::make_unique<FFmpegFrameQueue>(kOutputQueueSize);
+    mOutputPending = 0;
+    mOutputFlushing = false;
+    mOutputStopping = false;
+    mCurrentWorkIndex = kNoWorkIndex;
+    mCurrentWorkQueued = false;
+    mOutputThread = std::thread(&C2FFMPEGVideoDecodeComponent::outputThreadLoop, this);
+
+    ALOGD("startOutputThread: output stage enabled");
 }
 
-static bool comparePendingWork(const PendingWork& w1, const PendingWork& w2) {
-    return w1.second < w2.second;
+void C2FFMPEGVideoDecodeComponent::stopOutputThread() {
+    if (! mOutputThread.joinable()) {
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mOutputLock);
+        mOutputStopping = true;
+    }
+    mOutputCond.notify_all();
+    mOutputThread.join();
+
+    // The consumer is gone, drop whatever it did not get to.
+    mOutputQueue->clear();
+    mOutputQueue.reset();
+    mOutputPool.reset();
+    mHeldOutputs.clear();
+    mCurrentWorkIndex = kNoWorkIndex;
+    mCurrentWorkQueued = false;
 }
 
-void C2FFMPEGVideoDecodeComponent::pushPendingWork(const std::unique_ptr<C2Work>& work) {
-    uint32_t outputDelay = mIntf->getOutputDelay();
+void C2FFMPEGVideoDecodeComponent::outputThreadLoop() {
+    AVFrame* frame = av_frame_alloc();
 
-    if (mPendingWorkQueue.size() >= outputDelay) {
-        uint32_t newOutputDelay = outputDelay;
-        std::vector<std::unique_ptr<C2Param>> configUpdate;
+    LOG_ALWAYS_FATAL_IF(! frame, "outputThreadLoop: oom for video frame");
 
-        switch (mCtx->codec_id) {
-            case AV_CODEC_ID_HEVC:
-            case AV_CODEC_ID_H264:
-                // Increase output delay step-wise.
-                if (outputDelay >= 18u) {
-                    newOutputDelay = 34u;
-                } else if (outputDelay >= 8u) {
-                    newOutputDelay = 18u;
-                } else {
-                    newOutputDelay = 8u;
-                }
-                break;
-            default:
-                // Other codecs use constant output delay.
+    while (true) {
+        std::shared_ptr<C2BlockPool> pool;
+
+        {
+            std::unique_lock<std::mutex> lock(mOutputLock);
+
+            mOutputCond.wait(lock, [this] { return mOutputStopping || ! mOutputQueue->empty(); });
+            if (mOutputStopping) {
                 break;
+            }
+            pool = mOutputPool;
         }
 
-        if (newOutputDelay != outputDelay) {
-            C2PortActualDelayTuning::output delay(newOutputDelay);
-            std::vector<std::unique_ptr<C2SettingResult>> failures;
-            int err;
+        mOutputQueue->pop(frame);
 
-            err = mIntf->config({ &delay }, C2_MAY_BLOCK, &failures);
-            if (err == C2_OK) {
-                ALOGD("WorkQueue: queue full, output delay set to %u", newOutputDelay);
-                configUpdate.push_back(C2Param::Copy(delay));
+        if (! mOutputFlushing) {
+            OutputBuffer output;
+
+            output.index = getFrameIndex(frame);
+            output.result = renderFrame(frame, pool, &output.buffer, &output.configUpdate);
+            if (output.result != C2_OK) {
+                ALOGE("outputThreadLoop: failed to output frame idx=%" PRIu64 " err = %d",
+                      output.index, output.result);
             } else {
-                ALOGE("WorkQueue: output delay update to %u failed err = %d",
-                      newOutputDelay, err);
+                recordLatency(frame);
             }
-        }
 
-        auto fillEmptyWorkWithConfigUpdate = [&configUpdate](const std::unique_ptr<C2Work>& work) {
-            fillEmptyWork(work);
-            work->worklets.front()->output.configUpdate = std::move(configUpdate);
-        };
+            std::unique_lock<std::mutex> lock(mOutputLock);
 
-        finish(mPendingWorkQueue.front().first, fillEmptyWorkWithConfigUpdate);
-        mPendingWorkQueue.pop_front();
-    }
-#if DEBUG_WORKQUEUE
-    ALOGD("WorkQueue: push idx=%" PRIu64 ", ts=%" PRIu64,
-          work->input.ordinal.frameIndex.peeku(), work->input.ordinal.timestamp.peeku());
+            if (output.index == mCurrentWorkIndex) {
+                // process() is still running on this work, it is not known
+                // by SimpleC2Component yet so finish() would not find it.
+#if DEBUG_OUTPUT_STAGE
+                ALOGD("outputThreadLoop: holding idx=%" PRIu64, output.index);
 #endif
-    mPendingWorkQueue.push_back(PendingWork(work->input.ordinal.frameIndex.peeku(),
-                                            work->input.ordinal.timestamp.peeku()));
-    std::sort(mPendingWorkQueue.begin(), mPendingWorkQueue.end(), comparePendingWork);
-}
+                mHeldOutputs.push_back(std::move(output));
+            } else {
+                lock.unlock();
+                finishOutput(output.index, output.result, output.buffer, output.configUpdate);
+            }
+        }
+        av_frame_unref(frame);
 
-void C2FFMPEGVideoDecodeComponent::popPendingWork(const std::unique_ptr<C2Work>& work) {
-    uint64_t index = work->input.ordinal.frameIndex.peeku();
-    auto it = std::find_if(mPendingWorkQueue.begin(), mPendingWorkQueue.end(),
-                           [index](const PendingWork& pWork) { return index == pWork.first; });
+        {
+            std::lock_guard<std::mutex> lock(mOutputLock);
+            mOutputPending--;
+        }
+        mOutputCond.notify_all();
+    }
 
-#if DEBUG_WORKQUEUE
-    ALOGD("WorkQueue: pop idx=%" PRIu64 ", ts=%" PRIu64,
-          work->input.ordinal.frameIndex.peeku(), work->input.ordinal.timestamp.peeku());
-#endif
+    av_frame_free(&frame);
+}
 
-    if (it != mPendingWorkQueue.end()) {
-        mPendingWorkQueue.erase(it);
+c2_status_t C2FFMPEGVideoDecodeComponent::queueFrame() {
+    mOutputPending++;
+    if (getFrameIndex(mFrame) == mCurrentWorkIndex) {
+        mCurrentWorkQueued = true;
     }
-#if DEBUG_WORKQUEUE
-    else {
-        ALOGD("WorkQueue: pop work not found idx=%" PRIu64 ", ts=%" PRIu64,
-              work->input.ordinal.frameIndex.peeku(), work->input.ordinal.timestamp.peeku());
-    }
-#endif
-    prunePendingWorksUntil(work);
-}
 
-void C2FFMPEGVideoDecodeComponent::prunePendingWorksUntil(const std::unique_ptr<C2Work>& work) {
-#if DEBUG_WORKQUEUE
-    ALOGD("WorkQueue: prune until idx=%" PRIu64 ", ts=%" PRIu64,
-          work->input.ordinal.frameIndex.peeku(), work->input.ordinal.timestamp.peeku());
-#endif
-    // Drop all works with a PTS earlier than provided argument.
-    while (mPendingWorkQueue.size() > 0 &&
-           mPendingWorkQueue.front().second < work->input.ordinal.timestamp.peeku()) {
-        finish(mPendingWorkQueue.front().first, fillEmptyWork);
-        mPendingWorkQueue.pop_front();
+    // Only sleep when the output thread is behind.
+    while (! mOutputQueue->push(mFrame)) {
+        std::unique_lock<std::mutex> lock(mOutputLock);
+
+        mOutputCond.wait(lock, [this] { return ! mOutputQueue->full(); });
     }
-}
 
-c2_status_t C2FFMPEGVideoDecodeComponent::onInit() {
-    ALOGD("onInit");
-    return initDecoder();
-}
+    {
+        // Wake up the output thread.
+        std::lock_guard<std::mutex> lock(mOutputLock);
+    }
+    mOutputCond.notify_all();
 
-c2_status_t C2FFMPEGVideoDecodeComponent::onStop() {
-    ALOGD("onStop");
     return C2_OK;
 }
 
-void C2FFMPEGVideoDecodeComponent::onReset() {
-    ALOGD("onReset");
-    deInitDecoder();
-    initDecoder();
-}
+void C2FFMPEGVideoDecodeComponent::waitOutputIdle() {
+    std::unique_lock<std::mutex> lock(mOutputLock);
 
-void C2FFMPEGVideoDecodeComponent::onRelease() {
-    ALOGD("onRelease");
-    deInitDecoder();
-    if (mFFMPEGInitialized) {
-        deInitFFmpeg();
-        mFFMPEGInitialized = false;
-    }
+    mOutputCond.wait(lock, [this] { return mOutputPending == 0; });
 }
 
-c2_status_t C2FFMPEGVideoDecodeComponent::onFlush_sm() {
-    ALOGD("onFlush_sm");
-    if (mCtx && avcodec_is_open(mCtx)) {
-        // Make sure that the next buffer output does not still
-        // depend on fragments from the last one decoded.
-        avcodec_flush_buffers(mCtx);
-        mEOSSignalled = false;
+void C2FFMPEGVideoDecodeComponent::flushOutputStage() {
+    if (! mOutputQueue) {
+        return;
     }
-    return C2_OK;
-}
 
-c2_status_t C2FFMPEGVideoDecodeComponent::outputFrame(
-    const std::unique_ptr<C2Work>& work,
-    const std::shared_ptr<C2BlockPool> &pool
-) {
-    c2_status_t err;
-    std::vector<std::unique_ptr<C2Param>> configUpdate;
+    // Queued frames are dropped, the works are returned by the flush.
+    mOutputFlushing = true;
+    waitOutputIdle();
+    mOutputFlushing = false;
 
-#if DEBUG_FRAMES
-    ALOGD("outputFrame: pts=%" PRId64 " dts=%" PRId64 " ts=%" PRId64 " - %d x %d (%x)",
-          mFrame->pts, mFrame->pkt_dts, mFrame->best_effort_timestamp, mFrame->width, mFrame->height, mFrame->format);
-#endif
+    std::lock_guard<std::mutex> lock(mOutputLock);
+    mHeldOutputs.clear();
+    mCurrentWorkIndex = kNoWorkIndex;
+    mCurrentWorkQueued = false;
+}
 
-    if (mFrame->width != mIntf->getWidth() || mFrame->height != mIntf->getHeight()) {
-        ALOGD("outputFrame: video params changed - %d x %d (%x)", mFrame->width, mFrame->height, mFrame->format);
+void C2FFMPEGVideoDecodeComponent::beginOutputWork(
+    uint64_t index, const std::shared_ptr<C2BlockPool>& pool
+) {
+    std::deque<OutputBuffer> outputs;
 
-        C2StreamPictureSizeInfo::output size(0u, mFrame->width, mFrame->height);
-        std::vector<std::unique_ptr<C2SettingResult>> failures;
+    {
+        std::lock_guard<std::mutex> lock(mOutputLock);
 
-        err = mIntf->config({ &size }, C2_MAY_BLOCK, &failures);
-        if (err == OK) {
-            configUpdate.push_back(C2Param::Copy(size));
-            mCtx->width = mFrame->width;
-            mCtx->height = mFrame->height;
-        } else {
-            ALOGE("outputFrame: config update failed err = %d", err);
-            return C2_CORRUPTED;
-        }
+        // Only left by a work that failed in process(), SimpleC2Component
+        // has returned it since.
+        outputs.swap(mHeldOutputs);
+        mCurrentWorkIndex = index;
+        mCurrentWorkQueued = false;
+        mOutputPool = pool;
     }
 
-    std::shared_ptr<C2GraphicBlock> block;
-
-    err = pool->fetchGraphicBlock(mFrame->width, mFrame->height, HAL_PIXEL_FORMAT_YV12,
-                                  { C2MemoryUsage::CPU_READ, C2MemoryUsage::CPU_WRITE }, &block);
-
-    if (err != C2_OK) {
-        ALOGE("outputFrame: failed to fetch graphic block %d x %d (%x) err = %d",
-              mFrame->width, mFrame->height, HAL_PIXEL_FORMAT_YV12, err);
-        return C2_CORRUPTED;
+    for (auto& output : outputs) {
+        finishOutput(output.index, output.result, output.buffer, output.configUpdate);
     }
+}
 
-    C2GraphicView wView = block->map().get();
+void C2FFMPEGVideoDecodeComponent::endOutputWork(const std::unique_ptr<C2Work>& work) {
+    uint64_t index = work->input.ordinal.frameIndex.peeku();
+    std::deque<OutputBuffer> outputs;
 
-    err = wView.error();
-    if (err != C2_OK) {
-        ALOGE("outputFrame: graphic view map failed err = %d", err);
-        return C2_CORRUPTED;
+    if (mCurrentWorkQueued) {
+        // Once process() returns, nothing would finish an output held for
+        // this work until the next one comes: wait for it instead. Only
+        // happens without reordering, e.g. thumbnails and intra-only streams.
+        waitOutputIdle();
     }
 
-    err = getOutputBuffer(&wView);
-    if (err == C2_OK) {
-        std::shared_ptr<C2Buffer> buffer = createGraphicBuffer(std::move(block), C2Rect(mFrame->width, mFrame->height));
-
-        buffer->setInfo(mIntf->getPixelFormatInfo());
+    {
+        std::lock_guard<std::mutex> lock(mOutputLock);
 
-        if (work && c2_cntr64_t(mFrame->best_effort_timestamp) == work->input.ordinal.frameIndex) {
-            prunePendingWorksUntil(work);
-            work->worklets.front()->output.configUpdate = std::move(configUpdate);
-            work->worklets.front()->output.buffers.clear();
-            work->worklets.front()->output.buffers.push_back(buffer);
-            work->worklets.front()->output.ordinal = work->input.ordinal;
-            work->workletsProcessed = 1u;
-            work->result = C2_OK;
-        } else {
-            auto fillWork = [buffer, &configUpdate, this](const std::unique_ptr<C2Work>& work) {
-                popPendingWork(work);
-                work->worklets.front()->output.configUpdate = std::move(configUpdate);
-                work->worklets.front()->output.flags = (C2FrameData::flags_t)0;
-                work->worklets.front()->output.buffers.clear();
-                work->worklets.front()->output.buffers.push_back(buffer);
-                work->worklets.front()->output.ordinal = work->input.ordinal;
-                work->workletsProcessed = 1u;
-                work->result = C2_OK;
-#if DEBUG_FRAMES
-                ALOGD("outputFrame: work(finish) idx=%" PRIu64 ", processed=%u, result=%d",
-                      work->input.ordinal.frameIndex.peeku(), work->workletsProcessed, work->result);
-#endif
-            };
+        auto it = std::stable_partition(mHeldOutputs.begin(), mHeldOutputs.end(),
+                [index](const OutputBuffer& output) { return output.index != index; });
 
-            finish(mFrame->best_effort_timestamp, fillWork);
-        }
-    } else {
-        return err;
+        std::move(it, mHeldOutputs.end(), std::back_inserter(outputs));
+        mHeldOutputs.erase(it, mHeldOutputs.end());
+        // Later outputs of this work are finished by the output thread.
+        mCurrentWorkIndex = kNoWorkIndex;
+        mCurrentWorkQueued = false;
     }
 
-    return C2_OK;
+    // Outputs that are already available complete the work directly.
+    for (auto& output : outputs) {
+        prunePendingWorksUntil(work);
+        fillOutputWork(work, output.result, output.buffer, output.configUpdate);
+    }
 }
 
 void C2FFMPEGVideoDecodeComponent::process(
@@ -542,6 +2738,8 @@ void C2FFMPEGVideoDecodeComponent::process(
           work->input.buffers.size(), inSize, work->input.configUpdate.size(), work->input.infoBuffers.size());
 #endif
 
+    waitBackgroundOpen();
+
     if (mEOSSignalled) {
         ALOGE("process: ignoring work while EOS reached");
         work->workletsProcessed = 0u;
@@ -574,12 +2772,42 @@ void C2FFMPEGVideoDecodeComponent::process(
         c2_status_t err = C2_OK;
 
         if (work->input.flags & C2FrameData::FLAG_CODEC_CONFIG) {
+            if (mSpeculativeOpen) {
+                // More codec config, open the decoder again with it.
+                ALOGD("process: codec config changed, closing decoder opened ahead");
+                closeSpeculativeDecoder();
+            }
             work->workletsProcessed = 1u;
             work->result = processCodecConfig(&rView);
+            if (work->result == C2_OK && ! mStreamInfoProbed) {
+                probeStreamInfo(mCtx->extradata, mCtx->extradata_size, work);
+            }
+            if (work->result == C2_OK &&
+                    ffmpeg_codec_config_complete(mCodecID, mCtx->extradata, mCtx->extradata_size)) {
+                startBackgroundOpen();
+            }
             return;
         }
 
+        if (mSpeculativeOpen && mIntf->getLowLatencyMode() != mLowLatency) {
+            ALOGD("process: low latency mode changed, closing decoder opened ahead");
+            closeSpeculativeDecoder();
+        }
+
+        if (mWarmReset) {
+            err = finishWarmReset(work);
+            if (err != C2_OK) {
+                work->workletsProcessed = 1u;
+                work->result = err;
+                return;
+            }
+        }
+
         if (! mCodecAlreadyOpened) {
+            if (! mStreamInfoProbed) {
+                // No codec config (VP9), or in-band parameter sets.
+                probeStreamInfo(rView.data(), inSize, work);
+            }
             err = openDecoder();
             if (err != C2_OK) {
                 work->workletsProcessed = 1u;
@@ -587,19 +2815,43 @@ void C2FFMPEGVideoDecodeComponent::process(
                 return;
             }
         }
+        mSpeculativeOpen = false;
+
+        if (mDirectRendering) {
+            // Block pool used by get_buffer2().
+            std::lock_guard<std::mutex> lock(mDirectLock);
+            mDirectPool = pool;
+        }
+
+        if (mDrawHorizBand) {
+            // Block pool used by draw_horiz_band().
+            std::lock_guard<std::mutex> lock(mBandLock);
+            mBandPool = pool;
+        }
+
+        if (mOutputQueue) {
+            beginOutputWork(work->input.ordinal.frameIndex.peeku(), pool);
+        }
 
         bool inputConsumed = false;
+        bool inputDropped = ffmpeg_is_hidden_frame(mCodecID, rView.data(), inSize);
         bool outputAvailable = true;
         bool hasPicture = false;
 #if DEBUG_FRAMES
         int outputFrameCount = 0;
 #endif
 
+        nsecs_t decodeTime = 0;
+
         while (!inputConsumed || outputAvailable) {
+            nsecs_t decodeStart = systemTime(SYSTEM_TIME_MONOTONIC);
+
             if (!inputConsumed) {
-                err = sendInputBuffer(&rView, work->input.ordinal.frameIndex.peekll());
-                if (err == C2_OK) {
+                err = sendInputBuffer(&rView, work->input.ordinal.frameIndex.peeku(),
+                                      work->input.ordinal.timestamp.peeku());
+                if (err == C2_OK || err == C2_CORRUPTED) {
                     inputConsumed = true;
+                    inputDropped |= (err == C2_CORRUPTED);
                     outputAvailable = true;
                     work->input.buffers.clear();
                 } else if (err != C2_BAD_STATE) {
@@ -607,6 +2859,9 @@ void C2FFMPEGVideoDecodeComponent::process(
                     work->result = err;
                     return;
                 }
+                if (mFastStartPacket && mFastStartPacket->data) {
+                    decodeFastStart(work, pool);
+                }
             }
 
             if (outputAvailable) {
@@ -617,9 +2872,10 @@ void C2FFMPEGVideoDecodeComponent::process(
                     work->result = err;
                     return;
                 }
+                decodeTime += systemTime(SYSTEM_TIME_MONOTONIC) - decodeStart;
 
                 if (hasPicture) {
-                    err = outputFrame(work, pool);
+                    err = mOutputQueue ? queueFrame() : outputFrame(work, pool);
                     if (err != C2_OK) {
                         work->workletsProcessed = 1u;
                         work->result = err;
@@ -641,6 +2897,16 @@ void C2FFMPEGVideoDecodeComponent::process(
                 }
             }
         }
+
+        if (inputDropped && work->workletsProcessed == 0u) {
+            // Nothing will ever be output for this work, don't let it wait
+            // in the pending queue.
+            fillEmptyWork(work);
+        }
+
+        if (mDegradation && ! eos) {
+            updateDegradation(work, decodeTime);
+        }
     }
 #if DEBUG_FRAMES
     else {
@@ -648,12 +2914,24 @@ void C2FFMPEGVideoDecodeComponent::process(
     }
 #endif
 
+    if (mOutputQueue) {
+        if (eos) {
+            // All the frames must be out before the EOS work.
+            waitOutputIdle();
+        }
+        endOutputWork(work);
+    }
+
     if (eos) {
         mEOSSignalled = true;
         work->worklets.front()->output.flags = C2FrameData::FLAG_END_OF_STREAM;
         work->workletsProcessed = 1u;
     }
 
+    if (mCodecAlreadyOpened && ! eos) {
+        updateOutputDelay(work);
+    }
+
     if (work->workletsProcessed == 0u) {
         pushPendingWork(work);
     }
@@ -669,6 +2947,7 @@ c2_status_t C2FFMPEGVideoDecodeComponent::drain(
     const std::shared_ptr<C2BlockPool>& pool
 ) {
     ALOGD("drain: mode = %u", drainMode);
+    waitBackgroundOpen();
 
     if (drainMode == NO_DRAIN) {
         ALOGW("drain: NO_DRAIN is no-op");
@@ -686,16 +2965,35 @@ c2_status_t C2FFMPEGVideoDecodeComponent::drain(
     bool hasPicture = false;
     c2_status_t err = C2_OK;
 
-    err = sendInputBuffer(NULL, 0);
+    if (mOutputQueue) {
+        // No work is being processed, everything can be finished.
+        beginOutputWork(kNoWorkIndex, pool);
+    }
+
+    c2_status_t sendErr = sendInputBuffer(NULL, 0, 0);
+
     while (err == C2_OK) {
         hasPicture = false;
         err = receiveFrame(&hasPicture);
         if (hasPicture) {
             // Ignore errors at this point, just drain the decoder.
-            outputFrame(nullptr, pool);
-        } else {
+            if (mOutputQueue) {
+                queueFrame();
+            } else {
+                outputFrame(nullptr, pool);
+            }
+        } else if (sendErr != C2_BAD_STATE) {
             err = C2_NOT_FOUND;
         }
+        if (sendErr == C2_BAD_STATE) {
+            // Filtered packets were still queued, retry now that frames
+            // were read out.
+            sendErr = sendInputBuffer(NULL, 0, 0);
+        }
+    }
+
+    if (mOutputQueue) {
+        waitOutputIdle();
     }
 
     return C2_OK;
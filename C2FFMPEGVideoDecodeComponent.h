@@ -17,15 +17,30 @@
 #ifndef C2_FFMPEG_VIDEO_DECODE_COMPONENT_H
 #define C2_FFMPEG_VIDEO_DECODE_COMPONENT_H
 
+#include <atomic>
+#include <condition_variable>
 #include <deque>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
 #include <utility>
 #include <SimpleC2Component.h>
+#include <utils/Timers.h>
 #include "C2FFMPEGCommon.h"
+#include "C2FFMPEGPendingWorkQueue.h"
 #include "C2FFMPEGVideoDecodeInterface.h"
+#include "ffmpeg_probe.h"
+#include "ffmpeg_threadpool.h"
 
 namespace android {
 
-typedef std::pair<uint64_t, uint64_t> PendingWork;
+struct C2FFMPEGDirectBuffer;
+struct C2FFMPEGBandBuffer;
+class FFmpegFrameQueue;
+
+// Maximum number of bands converted in parallel.
+constexpr int kMaxConvertBands = 8;
 
 class C2FFMPEGVideoDecodeComponent : public SimpleC2Component {
 public:
@@ -50,14 +65,116 @@ protected:
 private:
     c2_status_t initDecoder();
     c2_status_t openDecoder();
+    void configureContext(AVCodecContext* ctx);
+    void applyDegradation(AVCodecContext* ctx);
+    void updateDegradation(const std::unique_ptr<C2Work>& work, nsecs_t decodeTime);
+    void setDegradationLevel(uint32_t level, std::vector<std::unique_ptr<C2Param>>* configUpdate);
+    c2_status_t attachDecoder();
+    void resetStreamState();
     void deInitDecoder();
+    bool adoptDecoder();
+    void recycleDecoder();
+    void warmReset();
+    c2_status_t finishWarmReset(const std::unique_ptr<C2Work>& work);
+    c2_status_t setExtradata(const uint8_t* data, size_t size);
+    void startBackgroundOpen();
+    void waitBackgroundOpen();
+    void closeSpeculativeDecoder();
     c2_status_t processCodecConfig(C2ReadView* inBuffer);
-    c2_status_t sendInputBuffer(C2ReadView* inBuffer, int64_t timestamp);
+    c2_status_t sendInputBuffer(C2ReadView* inBuffer, uint64_t frameIndex, uint64_t timestamp);
+    c2_status_t initBitstreamFilter(const std::string& filters);
+    void deInitBitstreamFilter();
+    c2_status_t sendFilteredPackets();
     c2_status_t receiveFrame(bool* hasPicture);
-    c2_status_t getOutputBuffer(C2GraphicView* outBuffer);
+    uint32_t selectOutputFormat(int format);
+    c2_status_t updatePictureSize(
+        uint32_t width, uint32_t height,
+        std::vector<std::unique_ptr<C2Param>>* configUpdate);
+    uint32_t updateOutputFormat(int format, std::vector<std::unique_ptr<C2Param>>* configUpdate);
+    void getBlockSize(int width, int height, uint32_t* blockWidth, uint32_t* blockHeight);
+    c2_status_t getOutputBuffer(AVFrame* frame, C2GraphicView* outBuffer);
+    c2_status_t convertFrame(
+        const AVFrame* frame, uint8_t* const data[4], const int linesize[4],
+        enum AVPixelFormat dstFormat);
+    c2_status_t renderFrame(
+        AVFrame* frame,
+        const std::shared_ptr<C2BlockPool> &pool,
+        std::shared_ptr<C2Buffer>* buffer,
+        std::vector<std::unique_ptr<C2Param>>* configUpdate);
     c2_status_t outputFrame(
         const std::unique_ptr<C2Work> &work,
         const std::shared_ptr<C2BlockPool> &pool);
+    void finishOutput(
+        uint64_t index, c2_status_t result,
+        const std::shared_ptr<C2Buffer>& buffer,
+        std::vector<std::unique_ptr<C2Param>>& configUpdate);
+    void recordLatency(const AVFrame* frame);
+
+    // Fast start
+    c2_status_t openFastStartDecoder();
+    void keepFastStartPacket(const AVPacket* packet);
+    void decodeFastStart(
+        const std::unique_ptr<C2Work>& work,
+        const std::shared_ptr<C2BlockPool>& pool);
+    void resetFastStart();
+
+    // Fast flush
+    AVCodecContext* createStandbyContext();
+    void startStandbyThread();
+    void stopStandbyThread();
+    void standbyThreadLoop();
+    bool swapStandbyDecoder();
+
+    // Output stage
+    struct OutputBuffer {
+        uint64_t index;
+        c2_status_t result;
+        std::shared_ptr<C2Buffer> buffer;
+        std::vector<std::unique_ptr<C2Param>> configUpdate;
+    };
+    void startOutputThread();
+    void stopOutputThread();
+    void outputThreadLoop();
+    c2_status_t queueFrame();
+    void waitOutputIdle();
+    void flushOutputStage();
+    void beginOutputWork(uint64_t index, const std::shared_ptr<C2BlockPool>& pool);
+    void endOutputWork(const std::unique_ptr<C2Work>& work);
+
+    // Direct rendering
+    static int getBuffer2(AVCodecContext* ctx, AVFrame* frame, int flags);
+    static void releaseDirectBuffer(void* opaque, uint8_t* data);
+    c2_status_t getDirectBuffer(AVCodecContext* ctx, AVFrame* frame);
+    bool getDirectBlock(AVFrame* frame, std::shared_ptr<C2GraphicBlock>* block);
+
+    // Shared worker pool
+    void attachThreadPool(AVCodecContext* ctx);
+    static int execute(
+        AVCodecContext* ctx, int (*func)(AVCodecContext* c2, void* arg),
+        void* arg, int* ret, int count, int size);
+    static int execute2(
+        AVCodecContext* ctx, int (*func)(AVCodecContext* c2, void* arg, int jobnr, int threadnr),
+        void* arg, int* ret, int count);
+
+    // Band by band conversion
+    static void drawHorizBand(AVCodecContext* ctx, const AVFrame* src,
+                              int offset[AV_NUM_DATA_POINTERS], int y, int type, int height);
+    void convertBand(const AVFrame* src, int y, int height);
+    bool getBandBlock(AVFrame* frame, uint32_t format, std::shared_ptr<C2GraphicBlock>* block);
+
+    // Stream probing and output delay
+    void probeStreamInfo(const uint8_t* data, int size, const std::unique_ptr<C2Work>& work);
+    int getCpuCount();
+    void planThreading(int* threadType, int* threadCount);
+    void reserveMemory();
+    uint32_t getMaxOutputDelay();
+    uint32_t getTargetOutputDelay();
+    int getMaxDirectBuffers();
+    bool setOutputDelay(uint32_t outputDelay, std::vector<std::unique_ptr<C2Param>>* configUpdate);
+    void updateOutputDelay(const std::unique_ptr<C2Work>& work);
+    void sendConfigUpdate(
+        const std::unique_ptr<C2Work>& work,
+        std::vector<std::unique_ptr<C2Param>>& configUpdate);
 
     void pushPendingWork(const std::unique_ptr<C2Work>& work);
     void popPendingWork(const std::unique_ptr<C2Work>& work);
@@ -68,14 +185,110 @@ private:
     std::shared_ptr<C2FFMPEGVideoDecodeInterface> mIntf;
     enum AVCodecID mCodecID;
     AVCodecContext* mCtx;
-    struct SwsContext *mImgConvertCtx;
+    // Owned by the thread rendering frames: the output thread while it runs,
+    // the component thread otherwise. Freed once the output thread stopped.
+    struct SwsContext *mImgConvertCtx[kMaxConvertBands];
     AVFrame* mFrame;
     AVPacket* mPacket;
+    AVBufferPool* mFrameInfoPool;
+    // Optional bitstream filters, mBsfPacket waits for the decoder if pending
+    AVBSFContext* mBsf;
+    AVPacket* mBsfPacket;
+    bool mBsfPending;
+    // Codec config received after the decoder was opened
+    std::vector<uint8_t> mPendingConfig;
     bool mFFMPEGInitialized;
     bool mCodecAlreadyOpened;
     bool mExtradataReady;
+    // Decoder kept open across a reset, codec config of the next session
+    bool mWarmReset;
+    std::vector<uint8_t> mWarmConfig;
+    // Decoder opened on a helper thread once the codec config is complete,
+    // closed again if more codec config comes before the first packet
+    bool mBackgroundOpen;
+    std::thread mOpenThread;
+    c2_status_t mOpenResult;
+    bool mSpeculativeOpen;
     bool mEOSSignalled;
-    std::deque<PendingWork> mPendingWorkQueue;
+    C2FFMPEGPendingWorkQueue mPendingWorkQueue;
+    // Also accessed by the output thread, finish() may recurse into it.
+    std::recursive_mutex mPendingWorkLock;
+    // Direct rendering
+    bool mDirectRendering;
+    std::mutex mDirectLock;
+    std::shared_ptr<C2BlockPool> mDirectPool;
+    std::set<C2FFMPEGDirectBuffer*> mDirectBuffers;
+    // Frames output without a copy and copied, logged when the decoder is closed
+    uint64_t mDirectFrames;
+    uint64_t mCopiedFrames;
+    // Band by band conversion
+    bool mDrawHorizBand;
+    std::mutex mBandLock;
+    std::shared_ptr<C2BlockPool> mBandPool;
+    std::deque<std::shared_ptr<C2FFMPEGBandBuffer>> mBandBuffers;
+    // Negotiated output pixel format, set by the output thread and by
+    // probeStreamInfo() on the component thread
+    std::mutex mOutputFormatLock;
+    uint32_t mOutputFormat;
+    // Output delay hysteresis
+    int mDelayShrinkCount;
+    uint32_t mDelayHighWater;
+    // Stream properties probed before opening the decoder
+    FFmpegStreamInfo mStreamInfo;
+    bool mStreamInfoProbed;
+    // Low latency mode, from the interface when the decoder was opened
+    bool mLowLatency;
+    // Slice jobs and conversions on the shared worker pool
+    FFmpegThreadPool::Session* mThreadSession;
+    // Usable CPUs, read once per decoder, 0 if not read yet
+    int mCpuCount;
+    // Limits from the memory budget, 0 if none
+    int mBudgetThreads;
+    uint32_t mBudgetOutputDelay;
+    // First picture after opening or flushing from a slice threaded decoder
+    AVCodecContext* mFastCtx;
+    bool mFastStart;
+    bool mFastStartPending;
+    // Key frame packet as sent to the decoder, waiting for the fast path
+    AVPacket* mFastStartPacket;
+    uint64_t mFastStartIndex;
+    // Fast flush: standby decoder with the same parameters swapped in on
+    // flush, replaced decoders flushed or freed on a separate thread
+    std::thread mStandbyThread;
+    std::mutex mStandbyLock;
+    std::condition_variable mStandbyCond;
+    AVCodecContext* mStandbyCtx;
+    AVCodecContext* mStandbyOpening;
+    std::deque<AVCodecContext*> mRetiredCtxs;
+    bool mStandbyStopping;
+    // In-band codec config given to the decoder, resent to the standby one
+    std::vector<uint8_t> mLateConfig;
+    // Load adaptive quality degradation, decoding time over a window of works
+    bool mDegradation;
+    uint32_t mDegradationLevel;
+    int mDegradationWorks;
+    nsecs_t mDegradationTime;
+    uint64_t mDegradationMinTs;
+    uint64_t mDegradationMaxTs;
+    int mRecoverWindows;
+    // Input to output latency, logged when the decoder is closed
+    std::mutex mLatencyLock;
+    uint64_t mLatencyFrames;
+    nsecs_t mLatencySum;
+    nsecs_t mLatencyMax;
+    // Output stage: block fetch, conversion and finish() on a separate thread
+    std::unique_ptr<FFmpegFrameQueue> mOutputQueue;
+    std::thread mOutputThread;
+    std::mutex mOutputLock;
+    std::condition_variable mOutputCond;
+    std::shared_ptr<C2BlockPool> mOutputPool;
+    std::deque<OutputBuffer> mHeldOutputs;
+    std::atomic<int> mOutputPending;
+    std::atomic<bool> mOutputFlushing;
+    bool mOutputStopping;
+    // Work in process(), and whether one of its frames was queued
+    uint64_t mCurrentWorkIndex;
+    bool mCurrentWorkQueued;
 };
 
 } // namespace android
@@ -17,15 +17,34 @@
 #define LOG_TAG "C2FFMPEGVideoDecodeInterface"
 #include <android-base/properties.h>
 #include <log/log.h>
-#include <thread>
+#include <algorithm>
 
 #include <media/stagefright/foundation/MediaDefs.h>
+#include <SimpleC2Component.h>
 #include "C2FFMPEGVideoDecodeInterface.h"
 
 namespace android {
 
 constexpr size_t kMaxDimension = 4080;
 
+static uint32_t getDefaultOutputDelay(const char* mediaType) {
+    if (strcasecmp(mediaType, MEDIA_MIMETYPE_VIDEO_MPEG2) == 0) {
+        return 3u;
+    }
+    if (strcasecmp(mediaType, MEDIA_MIMETYPE_VIDEO_AVC) == 0 ||
+        strcasecmp(mediaType, MEDIA_MIMETYPE_VIDEO_HEVC) == 0 ||
+        strcasecmp(mediaType, MEDIA_MIMETYPE_VIDEO_AV1) == 0) {
+        return 8u;
+    }
+
+    int nthreads = base::GetIntProperty("debug.ffmpeg_codec2.threads", 0);
+
+    if (nthreads <= 0) {
+        nthreads = ffmpeg_cpu_count();
+    }
+    return std::min(2u * nthreads, kMaxOutputDelay);
+}
+
 C2FFMPEGVideoDecodeInterface::C2FFMPEGVideoDecodeInterface(
         const C2FFMPEGComponentInfo* componentInfo,
         const std::shared_ptr<C2ReflectorHelper>& helper)
@@ -57,12 +76,30 @@ C2FFMPEGVideoDecodeInterface::C2FFMPEGVideoDecodeInterface(
             .withSetter(SizeSetter)
             .build());
 
-    if (strcasecmp(componentInfo->mediaType, MEDIA_MIMETYPE_VIDEO_MPEG2) == 0) {
-        addParameter(
-                DefineParam(mActualOutputDelay, C2_PARAMKEY_OUTPUT_DELAY)
-                .withConstValue(new C2PortActualDelayTuning::output(3u))
-                .build());
+    // Adaptive playback hint (max-width / max-height): output blocks are
+    // allocated at this size so that resolution switches below it keep
+    // recycling the same buffers.
+    addParameter(
+            DefineParam(mMaxSize, C2_PARAMKEY_MAX_PICTURE_SIZE)
+            .withDefault(new C2StreamMaxPictureSizeTuning::output(0u, 320, 240))
+            .withFields({
+                C2F(mMaxSize, width).inRange(2, kMaxDimension, 2),
+                C2F(mMaxSize, height).inRange(2, kMaxDimension, 2),
+            })
+            .withSetter(MaxPictureSizeSetter, mSize)
+            .build());
+
+    // Starting point only, the component adjusts it to the reorder depth and
+    // threading of the stream.
+    addParameter(
+            DefineParam(mActualOutputDelay, C2_PARAMKEY_OUTPUT_DELAY)
+            .withDefault(new C2PortActualDelayTuning::output(
+                    getDefaultOutputDelay(componentInfo->mediaType)))
+            .withFields({C2F(mActualOutputDelay, value).inRange(0, kMaxOutputDelay)})
+            .withSetter(Setter<decltype(*mActualOutputDelay)>::StrictValueWithNoDeps)
+            .build());
 
+    if (strcasecmp(componentInfo->mediaType, MEDIA_MIMETYPE_VIDEO_MPEG2) == 0) {
         addParameter(
                 DefineParam(mProfileLevel, C2_PARAMKEY_PROFILE_LEVEL)
                 .withDefault(new C2StreamProfileLevelInfo::input(0u,
@@ -82,13 +119,6 @@ C2FFMPEGVideoDecodeInterface::C2FFMPEGVideoDecodeInterface(
     }
 
     else if (strcasecmp(componentInfo->mediaType, MEDIA_MIMETYPE_VIDEO_AVC) == 0) {
-        addParameter(
-                DefineParam(mActualOutputDelay, C2_PARAMKEY_OUTPUT_DELAY)
-                .withDefault(new C2PortActualDelayTuning::output(8u))
-                .withFields({C2F(mActualOutputDelay, value).inRange(0, 34u)})
-                .withSetter(Setter<decltype(*mActualOutputDelay)>::StrictValueWithNoDeps)
-                .build());
-
         addParameter(
                 DefineParam(mProfileLevel, C2_PARAMKEY_PROFILE_LEVEL)
                 .withDefault(new C2StreamProfileLevelInfo::input(0u,
@@ -115,13 +145,6 @@ C2FFMPEGVideoDecodeInterface::C2FFMPEGVideoDecodeInterface(
     }
 
     else if (strcasecmp(componentInfo->mediaType, MEDIA_MIMETYPE_VIDEO_HEVC) == 0) {
-        addParameter(
-                DefineParam(mActualOutputDelay, C2_PARAMKEY_OUTPUT_DELAY)
-                .withDefault(new C2PortActualDelayTuning::output(8u))
-                .withFields({C2F(mActualOutputDelay, value).inRange(0, 34u)})
-                .withSetter(Setter<decltype(*mActualOutputDelay)>::StrictValueWithNoDeps)
-                .build());
-
         addParameter(
                 DefineParam(mProfileLevel, C2_PARAMKEY_PROFILE_LEVEL)
                 .withDefault(new C2StreamProfileLevelInfo::input(0u,
@@ -147,13 +170,6 @@ C2FFMPEGVideoDecodeInterface::C2FFMPEGVideoDecodeInterface(
     }
 
     else if (strcasecmp(componentInfo->mediaType, MEDIA_MIMETYPE_VIDEO_AV1) == 0) {
-        addParameter(
-                DefineParam(mActualOutputDelay, C2_PARAMKEY_OUTPUT_DELAY)
-                .withDefault(new C2PortActualDelayTuning::output(8u))
-                .withFields({C2F(mActualOutputDelay, value).inRange(0, 34u)})
-                .withSetter(Setter<decltype(*mActualOutputDelay)>::StrictValueWithNoDeps)
-                .build());
-
         addParameter(
                 DefineParam(mProfileLevel, C2_PARAMKEY_PROFILE_LEVEL)
                 .withDefault(new C2StreamProfileLevelInfo::input(0u,
@@ -178,17 +194,6 @@ C2FFMPEGVideoDecodeInterface::C2FFMPEGVideoDecodeInterface(
     }
 
     else {
-        int nthreads = base::GetIntProperty("debug.ffmpeg_codec2.threads", 0);
-
-        if (nthreads <= 0) {
-            nthreads = std::thread::hardware_concurrency();
-        }
-
-        addParameter(
-                DefineParam(mActualOutputDelay, C2_PARAMKEY_OUTPUT_DELAY)
-                .withConstValue(new C2PortActualDelayTuning::output(2 * nthreads))
-                .build());
-
         if (strcasecmp(componentInfo->mediaType, MEDIA_MIMETYPE_VIDEO_VP9) == 0) {
             addParameter(
                     DefineParam(mProfileLevel, C2_PARAMKEY_PROFILE_LEVEL)
@@ -227,15 +232,35 @@ C2FFMPEGVideoDecodeInterface::C2FFMPEGVideoDecodeInterface(
                 0u, 8u /* bitDepth */, C2Color::YUV_420);
     helper->addStructDescriptors<C2ChromaOffsetStruct>();
 
+    // Updated by the component when the output bit depth changes.
     addParameter(
             DefineParam(mColorInfo, C2_PARAMKEY_CODED_COLOR_INFO)
-            .withConstValue(defaultColorInfo)
+            .withDefault(defaultColorInfo)
+            .withFields({C2F(mColorInfo, m.bitDepth).oneOf({8u, 10u})})
+            .withSetter(ColorInfoSetter)
             .build());
 
+    // Flexible YUV lets the component pick the block layout matching the
+    // decoder output: YV12 for planar formats, or a semi-planar (NV12)
+    // gralloc layout for the HW accelerated path.
+    std::vector<uint32_t> pixelFormats = {
+        HAL_PIXEL_FORMAT_YCBCR_420_888,
+        HAL_PIXEL_FORMAT_YV12,
+    };
+
+    // High bit depth streams are output as P010 when requested, or when
+    // decoding to a surface. Flexible YUV stays 8-bit.
+    if (isHalPixelFormatSupported((AHardwareBuffer_Format)HAL_PIXEL_FORMAT_YCBCR_P010)) {
+        pixelFormats.push_back(HAL_PIXEL_FORMAT_YCBCR_P010);
+        pixelFormats.push_back(HAL_PIXEL_FORMAT_IMPLEMENTATION_DEFINED);
+    }
+
     addParameter(
             DefineParam(mPixelFormat, C2_PARAMKEY_PIXEL_FORMAT)
-            .withConstValue(new C2StreamPixelFormatInfo::output(
-                                 0u, HAL_PIXEL_FORMAT_YV12))
+            .withDefault(new C2StreamPixelFormatInfo::output(
+                                 0u, HAL_PIXEL_FORMAT_YCBCR_420_888))
+            .withFields({C2F(mPixelFormat, value).oneOf(pixelFormats)})
+            .withSetter(Setter<decltype(*mPixelFormat)>::StrictValueWithNoDeps)
             .build());
 
     addParameter(
@@ -245,6 +270,39 @@ C2FFMPEGVideoDecodeInterface::C2FFMPEGVideoDecodeInterface(
             .withFields({C2F(mConsumerUsage, value).any()})
             .withSetter(Setter<decltype(*mConsumerUsage)>::StrictValueWithNoDeps)
             .build());
+
+    // Decode without frame threading or reordering delay, see openDecoder().
+    addParameter(
+            DefineParam(mLowLatencyMode, C2_PARAMKEY_LOW_LATENCY_MODE)
+            .withDefault(new C2GlobalLowLatencyModeTuning(0))
+            .withFields({C2F(mLowLatencyMode, value).oneOf({0, 1})})
+            .withSetter(Setter<decltype(*mLowLatencyMode)>::StrictValueWithNoDeps)
+            .build());
+
+    // MediaFormat "priority": 0 is real time, anything else best effort.
+    // Best effort sessions give way when memory is short.
+    addParameter(
+            DefineParam(mRealTimePriority, C2_PARAMKEY_PRIORITY)
+            .withDefault(new C2RealTimePriorityTuning(0))
+            .withFields({C2F(mRealTimePriority, value).any()})
+            .withSetter(Setter<decltype(*mRealTimePriority)>::NonStrictValueWithNoDeps)
+            .build());
+
+    // Set by the component, see updateDegradation().
+    addParameter(
+            DefineParam(mDegradationLevel, C2_PARAMKEY_FFMPEG_DEGRADATION_LEVEL)
+            .withDefault(new C2StreamFFmpegDegradationLevelInfo::output(0u, 0u))
+            .withFields({C2F(mDegradationLevel, value).inRange(0u, kMaxDegradationLevel)})
+            .withSetter(DegradationLevelSetter)
+            .build());
+
+    // Set by the component, see reserveMemory().
+    addParameter(
+            DefineParam(mMemoryUsage, C2_PARAMKEY_FFMPEG_MEMORY_USAGE)
+            .withDefault(new C2StreamFFmpegMemoryUsageInfo::output(0u, 0u))
+            .withFields({C2F(mMemoryUsage, value).any()})
+            .withSetter(MemoryUsageSetter)
+            .build());
 }
 
 C2R C2FFMPEGVideoDecodeInterface::SizeSetter(
@@ -265,6 +323,28 @@ C2R C2FFMPEGVideoDecodeInterface::SizeSetter(
     return res;
 }
 
+C2R C2FFMPEGVideoDecodeInterface::MaxPictureSizeSetter(
+        bool /* mayBlock */,
+        C2P<C2StreamMaxPictureSizeTuning::output> &me,
+        const C2P<C2StreamPictureSizeInfo::output> &size) {
+    me.set().width = c2_min(c2_max(me.v.width, size.v.width), (uint32_t)kMaxDimension);
+    me.set().height = c2_min(c2_max(me.v.height, size.v.height), (uint32_t)kMaxDimension);
+    return C2R::Ok();
+}
+
+C2R C2FFMPEGVideoDecodeInterface::ColorInfoSetter(
+        bool /* mayBlock */,
+        C2P<C2StreamColorInfo::output> &me) {
+    C2R res = C2R::Ok();
+
+    if (!me.F(me.v.m.bitDepth).supportsAtAll(me.v.m.bitDepth)) {
+        res = res.plus(C2SettingResultBuilder::BadValue(me.F(me.v.m.bitDepth)));
+        me.set().m.bitDepth = 8u;
+    }
+
+    return res;
+}
+
 C2R C2FFMPEGVideoDecodeInterface::ProfileLevelSetter(
         bool /* mayBlock */,
         C2P<C2StreamProfileLevelInfo::input>& /* me */,
@@ -272,4 +352,22 @@ C2R C2FFMPEGVideoDecodeInterface::ProfileLevelSetter(
     return C2R::Ok();
 }
 
+C2R C2FFMPEGVideoDecodeInterface::DegradationLevelSetter(
+        bool /* mayBlock */,
+        const C2P<C2StreamFFmpegDegradationLevelInfo::output> &oldMe,
+        C2P<C2StreamFFmpegDegradationLevelInfo::output> &me) {
+    // Read only, the component updates it through setDegradationLevel().
+    me.set().value = oldMe.v.value;
+    return C2R::Ok();
+}
+
+C2R C2FFMPEGVideoDecodeInterface::MemoryUsageSetter(
+        bool /* mayBlock */,
+        const C2P<C2StreamFFmpegMemoryUsageInfo::output> &oldMe,
+        C2P<C2StreamFFmpegMemoryUsageInfo::output> &me) {
+    // Read only, the component updates it through setMemoryUsage().
+    me.set().value = oldMe.v.value;
+    return C2R::Ok();
+}
+
 } // namespace android
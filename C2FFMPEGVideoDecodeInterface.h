@@ -22,6 +22,28 @@
 
 namespace android {
 
+// Upper bound of the output delay.
+constexpr uint32_t kMaxOutputDelay = 34u;
+
+// Quality given up by the decoder to keep up with real time:
+// 1: AV_CODEC_FLAG2_FAST, 2: no loop filter on non-reference pictures,
+// 3: non-reference pictures skipped.
+constexpr uint32_t kMaxDegradationLevel = 3u;
+
+enum : uint32_t {
+    kParamIndexFFmpegDegradationLevel = C2Param::TYPE_INDEX_VENDOR_START,
+    kParamIndexFFmpegMemoryUsage,
+};
+
+typedef C2StreamParam<C2Info, C2Uint32Value, kParamIndexFFmpegDegradationLevel>
+        C2StreamFFmpegDegradationLevelInfo;
+constexpr char C2_PARAMKEY_FFMPEG_DEGRADATION_LEVEL[] = "vendor.ffmpeg.degradation-level";
+
+// Memory reserved by the session in the memory budget, in KB.
+typedef C2StreamParam<C2Info, C2Uint32Value, kParamIndexFFmpegMemoryUsage>
+        C2StreamFFmpegMemoryUsageInfo;
+constexpr char C2_PARAMKEY_FFMPEG_MEMORY_USAGE[] = "vendor.ffmpeg.memory-usage";
+
 class C2FFMPEGVideoDecodeInterface : public SimpleInterface<void>::BaseParams {
 public:
     explicit C2FFMPEGVideoDecodeInterface(
@@ -30,27 +52,55 @@ public:
 
     uint32_t getWidth() const { return mSize->width; }
     uint32_t getHeight() const { return mSize->height; }
+    uint32_t getMaxWidth() const { return mMaxSize->width; }
+    uint32_t getMaxHeight() const { return mMaxSize->height; }
     uint64_t getConsumerUsage() const { return mConsumerUsage->value; }
-    const std::shared_ptr<C2StreamPixelFormatInfo::output>&
-        getPixelFormatInfo() const { return mPixelFormat; }
+    uint32_t getPixelFormat() const { return mPixelFormat->value; }
     uint32_t getOutputDelay() const { return mActualOutputDelay->value; }
+    uint32_t getBitDepth() const { return mColorInfo->m.bitDepth; }
+    bool getLowLatencyMode() const { return mLowLatencyMode->value; }
+    bool isRealTime() const { return mRealTimePriority->value == 0; }
+    uint32_t getDegradationLevel() const { return mDegradationLevel->value; }
+    // Reported by the component, clients cannot set them.
+    void setDegradationLevel(uint32_t level) { mDegradationLevel->value = level; }
+    void setMemoryUsage(uint32_t kbytes) { mMemoryUsage->value = kbytes; }
 
 private:
     static C2R SizeSetter(
         bool mayBlock,
         const C2P<C2StreamPictureSizeInfo::output> &oldMe,
         C2P<C2StreamPictureSizeInfo::output> &me);
+    static C2R MaxPictureSizeSetter(
+        bool mayBlock,
+        C2P<C2StreamMaxPictureSizeTuning::output> &me,
+        const C2P<C2StreamPictureSizeInfo::output> &size);
+    static C2R ColorInfoSetter(
+        bool mayBlock,
+        C2P<C2StreamColorInfo::output> &me);
     static C2R ProfileLevelSetter(
         bool mayBlock,
         C2P<C2StreamProfileLevelInfo::input> &me,
         const C2P<C2StreamPictureSizeInfo::output> &size);
+    static C2R DegradationLevelSetter(
+        bool mayBlock,
+        const C2P<C2StreamFFmpegDegradationLevelInfo::output> &oldMe,
+        C2P<C2StreamFFmpegDegradationLevelInfo::output> &me);
+    static C2R MemoryUsageSetter(
+        bool mayBlock,
+        const C2P<C2StreamFFmpegMemoryUsageInfo::output> &oldMe,
+        C2P<C2StreamFFmpegMemoryUsageInfo::output> &me);
 
 private:
     std::shared_ptr<C2StreamPictureSizeInfo::output> mSize;
+    std::shared_ptr<C2StreamMaxPictureSizeTuning::output> mMaxSize;
     std::shared_ptr<C2StreamProfileLevelInfo::input> mProfileLevel;
     std::shared_ptr<C2StreamColorInfo::output> mColorInfo;
     std::shared_ptr<C2StreamPixelFormatInfo::output> mPixelFormat;
     std::shared_ptr<C2StreamUsageTuning::output> mConsumerUsage;
+    std::shared_ptr<C2GlobalLowLatencyModeTuning> mLowLatencyMode;
+    std::shared_ptr<C2RealTimePriorityTuning> mRealTimePriority;
+    std::shared_ptr<C2StreamFFmpegDegradationLevelInfo::output> mDegradationLevel;
+    std::shared_ptr<C2StreamFFmpegMemoryUsageInfo::output> mMemoryUsage;
 };
 
 } // namespace android
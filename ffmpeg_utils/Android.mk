@@ -24,7 +24,13 @@ LOCAL_PROPRIETARY_MODULE := true
 LOCAL_MODULE_TAGS := optional
 
 LOCAL_SRC_FILES := \
+    ffmpeg_budget.cpp \
+    ffmpeg_convert.cpp \
+    ffmpeg_decoderpool.cpp \
+    ffmpeg_framequeue.cpp \
     ffmpeg_hwaccel.c \
+    ffmpeg_probe.cpp \
+    ffmpeg_threadpool.cpp \
     ffmpeg_utils.cpp
 
 LOCAL_SHARED_LIBRARIES += \
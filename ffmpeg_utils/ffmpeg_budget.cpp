@@ -0,0 +1,148 @@
+/*
+ * Copyright (C) 2024 KonstaKANG
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "FFMPEG"
+#include <utils/Log.h>
+
+#include <cutils/properties.h>
+#include <algorithm>
+
+#include "ffmpeg_budget.h"
+
+namespace android {
+
+FFmpegMemoryBudget& FFmpegMemoryBudget::instance() {
+    static FFmpegMemoryBudget* sInstance = new FFmpegMemoryBudget();
+    return *sInstance;
+}
+
+FFmpegMemoryBudget::FFmpegMemoryBudget()
+    : mLimit((size_t)std::max(property_get_int32("persist.ffmpeg_codec2.memory_budget_mb", 0), 0) << 20) {
+}
+
+size_t FFmpegMemoryBudget::getPictureSize(const FFmpegMemoryRequest& request) {
+    // Decoders pad pictures to their block size and add borders for motion
+    // vectors pointing outside: 64 samples on each side covers them all.
+    size_t luma = (size_t)(request.width + 128) * (request.height + 128);
+    size_t size;
+
+    switch (request.chroma_format) {
+    case 0:
+        size = luma;
+        break;
+    case 2:
+        size = luma * 2;
+        break;
+    case 3:
+        size = luma * 3;
+        break;
+    default:
+        size = luma * 3 / 2;
+        break;
+    }
+    return request.bit_depth > 8 ? size * 2 : size;
+}
+
+size_t FFmpegMemoryBudget::getFootprint(const FFmpegMemoryRequest& request) {
+    return getPictureSize(request) *
+           (request.references + request.threads + request.output_delay + request.extra_pictures);
+}
+
+size_t FFmpegMemoryBudget::reserve(const void* session, FFmpegMemoryRequest* request) {
+    std::lock_guard<std::mutex> lock(mLock);
+    size_t pictureSize = getPictureSize(*request);
+    size_t bytes = getFootprint(*request);
+    size_t minBytes = pictureSize *
+                      (request->references + 1 + request->min_output_delay + request->extra_pictures);
+
+    mSessions.erase(session);
+
+    if (mLimit) {
+        size_t others = 0;
+
+        for (const auto& it : mSessions) {
+            others += (it.second.priority >= request->priority) ? it.second.bytes : it.second.minBytes;
+        }
+
+        size_t available = (others < mLimit) ? mLimit - others : 0;
+
+        if (bytes > available) {
+            // Threads first, then output delay.
+            while (getFootprint(*request) > available) {
+                if (request->threads > 1) {
+                    request->threads--;
+                    // Each frame thread also holds a picture of output delay.
+                    if (request->frame_threads && request->output_delay > request->min_output_delay) {
+                        request->output_delay--;
+                    }
+                } else if (request->output_delay > request->min_output_delay) {
+                    request->output_delay--;
+                } else {
+                    break;
+                }
+            }
+            bytes = getFootprint(*request);
+
+            ALOGW("FFmpegMemoryBudget: %p over budget, reduced to %d threads, delay %d",
+                  session, request->threads, request->output_delay);
+        }
+    }
+
+    mSessions[session] = Reservation{ request->priority, bytes, std::min(bytes, minBytes) };
+
+    size_t total = 0;
+
+    for (const auto& it : mSessions) {
+        total += it.second.bytes;
+    }
+
+    ALOGD("FFmpegMemoryBudget: %p %dx%d reserved %zu KB, total %zu KB of %zu KB (%zu sessions)",
+          session, request->width, request->height, bytes >> 10, total >> 10, mLimit >> 10,
+          mSessions.size());
+
+    return bytes;
+}
+
+void FFmpegMemoryBudget::release(const void* session) {
+    std::lock_guard<std::mutex> lock(mLock);
+
+    if (mSessions.erase(session)) {
+        ALOGD("FFmpegMemoryBudget: %p released", session);
+    }
+}
+
+size_t FFmpegMemoryBudget::getUsage(const void* session) {
+    std::lock_guard<std::mutex> lock(mLock);
+    auto it = mSessions.find(session);
+
+    return it != mSessions.end() ? it->second.bytes : 0;
+}
+
+size_t FFmpegMemoryBudget::getTotalUsage() {
+    std::lock_guard<std::mutex> lock(mLock);
+    size_t total = 0;
+
+    for (const auto& it : mSessions) {
+        total += it.second.bytes;
+    }
+    return total;
+}
+
+size_t FFmpegMemoryBudget::getLimit() {
+    return mLimit;
+}
+
+}  // namespace android
@@ -0,0 +1,86 @@
+/*
+ * Copyright (C) 2024 KonstaKANG
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef FFMPEG_BUDGET_H_
+
+#define FFMPEG_BUDGET_H_
+
+#include <stddef.h>
+#include <map>
+#include <mutex>
+
+namespace android {
+
+//////////////////////////////////////////////////////////////////////////////////
+// Process-wide memory budget of the decoding sessions. A session holds
+// about one picture per reference frame, per frame thread and per work of
+// output delay, which is what gets reserved.
+//////////////////////////////////////////////////////////////////////////////////
+struct FFmpegMemoryRequest {
+    int width;
+    int height;
+    int bit_depth;
+    // 0: monochrome, 1: 4:2:0, 2: 4:2:2, 3: 4:4:4
+    int chroma_format;
+    int references;
+    int threads;
+    bool frame_threads;
+    int output_delay;
+    // Pictures held by a second decoder of the session, as for fast start.
+    int extra_pictures;
+    // Lowest output delay that does not drop pictures.
+    int min_output_delay;
+    // Sessions of higher priority are served first.
+    int priority;
+};
+
+class FFmpegMemoryBudget {
+public:
+    static FFmpegMemoryBudget& instance();
+
+    static size_t getPictureSize(const FFmpegMemoryRequest& request);
+    static size_t getFootprint(const FFmpegMemoryRequest& request);
+
+    // Reserves memory for the session, replacing its previous reservation.
+    // If the request does not fit, the thread count and then the output
+    // delay are lowered, down to 1 thread and min_output_delay. Sessions of
+    // lower priority only count for their minimum, they get the rest when
+    // they reserve again. Returns the bytes reserved.
+    size_t reserve(const void* session, FFmpegMemoryRequest* request);
+    void release(const void* session);
+
+    size_t getUsage(const void* session);
+    size_t getTotalUsage();
+    // 0 if unlimited.
+    size_t getLimit();
+
+private:
+    struct Reservation {
+        int priority;
+        size_t bytes;
+        size_t minBytes;
+    };
+
+    FFmpegMemoryBudget();
+
+    std::mutex mLock;
+    std::map<const void*, Reservation> mSessions;
+    size_t mLimit;
+};
+
+}  // namespace android
+
+#endif  // FFMPEG_BUDGET_H_
@@ -0,0 +1,832 @@
+/*
+ * Copyright (C) 2024 KonstaKANG
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "FFMPEG"
+#include <utils/Log.h>
+
+#include <string.h>
+
+extern "C" {
+
+#include "libavutil/cpu.h"
+
+}
+
+#if defined(__i386__) || defined(__x86_64__)
+#include <immintrin.h>
+#define HAVE_X86_KERNELS 1
+#endif
+
+#if defined(__ARM_NEON)
+#include <arm_neon.h>
+#define HAVE_NEON_KERNELS 1
+#endif
+
+#include "ffmpeg_convert.h"
+
+namespace android {
+
+//////////////////////////////////////////////////////////////////////////////////
+// row kernels
+//////////////////////////////////////////////////////////////////////////////////
+
+// All kernels process a single row of n output samples. Destination rows are
+// written with non-temporal stores where available: the output goes to
+// gralloc memory that is not read back by the CPU.
+struct ConvertKernels {
+    const char* name;
+    void (*copy)(uint8_t* dst, const uint8_t* src, int n);
+    void (*deinterleave)(uint8_t* dst0, uint8_t* dst1, const uint8_t* src, int n);
+    void (*interleave)(uint8_t* dst, const uint8_t* src0, const uint8_t* src1, int n);
+    void (*avg_rows)(uint8_t* dst, const uint8_t* src0, const uint8_t* src1, int n);
+    void (*avg_2x2)(uint8_t* dst, const uint8_t* src0, const uint8_t* src1, int n);
+    // High bit depth: samples are 16-bit, shift gives the position of the
+    // significant bits. The dither pattern has a period of 8 samples.
+    void (*shl16)(uint16_t* dst, const uint16_t* src, int n, int shift);
+    void (*interleave16)(uint16_t* dst, const uint16_t* src0, const uint16_t* src1, int n, int shift);
+    void (*dither16)(uint8_t* dst, const uint16_t* src, int n, int shift, const uint16_t* dither);
+    void (*fence)();
+};
+
+static void copy_c(uint8_t* dst, const uint8_t* src, int n) {
+    memcpy(dst, src, n);
+}
+
+static void deinterleave_c(uint8_t* dst0, uint8_t* dst1, const uint8_t* src, int n) {
+    for (int i = 0; i < n; i++) {
+        dst0[i] = src[2 * i];
+        dst1[i] = src[2 * i + 1];
+    }
+}
+
+static void interleave_c(uint8_t* dst, const uint8_t* src0, const uint8_t* src1, int n) {
+    for (int i = 0; i < n; i++) {
+        dst[2 * i] = src0[i];
+        dst[2 * i + 1] = src1[i];
+    }
+}
+
+static void avg_rows_c(uint8_t* dst, const uint8_t* src0, const uint8_t* src1, int n) {
+    for (int i = 0; i < n; i++) {
+        dst[i] = (src0[i] + src1[i] + 1) >> 1;
+    }
+}
+
+static void avg_2x2_c(uint8_t* dst, const uint8_t* src0, const uint8_t* src1, int n) {
+    for (int i = 0; i < n; i++) {
+        dst[i] = (src0[2 * i] + src0[2 * i + 1] + src1[2 * i] + src1[2 * i + 1] + 2) >> 2;
+    }
+}
+
+static void shl16_c(uint16_t* dst, const uint16_t* src, int n, int shift) {
+    for (int i = 0; i < n; i++) {
+        dst[i] = src[i] << shift;
+    }
+}
+
+static void interleave16_c(uint16_t* dst, const uint16_t* src0, const uint16_t* src1, int n, int shift) {
+    for (int i = 0; i < n; i++) {
+        dst[2 * i] = src0[i] << shift;
+        dst[2 * i + 1] = src1[i] << shift;
+    }
+}
+
+// 10 to 8 bits with an ordered dither instead of truncation, which would
+// show banding in gradients.
+static void dither16_c(uint8_t* dst, const uint16_t* src, int n, int shift, const uint16_t* dither) {
+    for (int i = 0; i < n; i++) {
+        int v = ((src[i] >> shift) + dither[i & 7]) >> 2;
+        dst[i] = v > 255 ? 255 : v;
+    }
+}
+
+static void fence_c() {
+}
+
+static const ConvertKernels kKernelsC = {
+    "c", copy_c, deinterleave_c, interleave_c, avg_rows_c, avg_2x2_c,
+    shl16_c, interleave16_c, dither16_c, fence_c
+};
+
+#ifdef HAVE_X86_KERNELS
+
+// Number of scalar samples to process until dst is aligned on align bytes.
+static inline int head_count(const uint8_t* dst, int align, int n) {
+    int head = (align - ((uintptr_t)dst & (align - 1))) & (align - 1);
+    return head < n ? head : n;
+}
+
+static void copy_sse2(uint8_t* dst, const uint8_t* src, int n) {
+    int i = head_count(dst, 16, n);
+
+    memcpy(dst, src, i);
+    for (; i + 16 <= n; i += 16) {
+        _mm_stream_si128((__m128i*)(dst + i), _mm_loadu_si128((const __m128i*)(src + i)));
+    }
+    memcpy(dst + i, src + i, n - i);
+}
+
+static void deinterleave_sse2(uint8_t* dst0, uint8_t* dst1, const uint8_t* src, int n) {
+    const __m128i mask = _mm_set1_epi16(0x00ff);
+    // Streaming stores need both destinations aligned the same way, which
+    // is the case for YV12 chroma planes.
+    bool stream = ((uintptr_t)dst0 & 15) == ((uintptr_t)dst1 & 15);
+    int i = stream ? head_count(dst0, 16, n) : 0;
+
+    deinterleave_c(dst0, dst1, src, i);
+    for (; i + 16 <= n; i += 16) {
+        __m128i a = _mm_loadu_si128((const __m128i*)(src + 2 * i));
+        __m128i b = _mm_loadu_si128((const __m128i*)(src + 2 * i + 16));
+        __m128i u = _mm_packus_epi16(_mm_and_si128(a, mask), _mm_and_si128(b, mask));
+        __m128i v = _mm_packus_epi16(_mm_srli_epi16(a, 8), _mm_srli_epi16(b, 8));
+        if (stream) {
+            _mm_stream_si128((__m128i*)(dst0 + i), u);
+            _mm_stream_si128((__m128i*)(dst1 + i), v);
+        } else {
+            _mm_storeu_si128((__m128i*)(dst0 + i), u);
+            _mm_storeu_si128((__m128i*)(dst1 + i), v);
+        }
+    }
+    deinterleave_c(dst0 + i, dst1 + i, src + 2 * i, n - i);
+}
+
+static void interleave_sse2(uint8_t* dst, const uint8_t* src0, const uint8_t* src1, int n) {
+    // Output is twice as large, align on the output position.
+    int i = head_count(dst, 16, 2 * n) / 2;
+
+    interleave_c(dst, src0, src1, i);
+    if (((uintptr_t)(dst + 2 * i) & 15) == 0) {
+        for (; i + 16 <= n; i += 16) {
+            __m128i a = _mm_loadu_si128((const __m128i*)(src0 + i));
+            __m128i b = _mm_loadu_si128((const __m128i*)(src1 + i));
+            _mm_stream_si128((__m128i*)(dst + 2 * i), _mm_unpacklo_epi8(a, b));
+            _mm_stream_si128((__m128i*)(dst + 2 * i + 16), _mm_unpackhi_epi8(a, b));
+        }
+    }
+    interleave_c(dst + 2 * i, src0 + i, src1 + i, n - i);
+}
+
+static void avg_rows_sse2(uint8_t* dst, const uint8_t* src0, const uint8_t* src1, int n) {
+    int i = head_count(dst, 16, n);
+
+    avg_rows_c(dst, src0, src1, i);
+    for (; i + 16 <= n; i += 16) {
+        __m128i a = _mm_loadu_si128((const __m128i*)(src0 + i));
+        __m128i b = _mm_loadu_si128((const __m128i*)(src1 + i));
+        _mm_stream_si128((__m128i*)(dst + i), _mm_avg_epu8(a, b));
+    }
+    avg_rows_c(dst + i, src0 + i, src1 + i, n - i);
+}
+
+// Sum of horizontal pairs of 8-bit samples, on 16 bits.
+static inline __m128i hadd_pairs_sse2(__m128i v) {
+    return _mm_add_epi16(_mm_and_si128(v, _mm_set1_epi16(0x00ff)), _mm_srli_epi16(v, 8));
+}
+
+static void avg_2x2_sse2(uint8_t* dst, const uint8_t* src0, const uint8_t* src1, int n) {
+    const __m128i round = _mm_set1_epi16(2);
+    int i = head_count(dst, 16, n);
+
+    avg_2x2_c(dst, src0, src1, i);
+    for (; i + 16 <= n; i += 16) {
+        __m128i a = _mm_add_epi16(hadd_pairs_sse2(_mm_loadu_si128((const __m128i*)(src0 + 2 * i))),
+                                  hadd_pairs_sse2(_mm_loadu_si128((const __m128i*)(src1 + 2 * i))));
+        __m128i b = _mm_add_epi16(hadd_pairs_sse2(_mm_loadu_si128((const __m128i*)(src0 + 2 * i + 16))),
+                                  hadd_pairs_sse2(_mm_loadu_si128((const __m128i*)(src1 + 2 * i + 16))));
+        a = _mm_srli_epi16(_mm_add_epi16(a, round), 2);
+        b = _mm_srli_epi16(_mm_add_epi16(b, round), 2);
+        _mm_stream_si128((__m128i*)(dst + i), _mm_packus_epi16(a, b));
+    }
+    avg_2x2_c(dst + i, src0 + 2 * i, src1 + 2 * i, n - i);
+}
+
+// Same as head_count() for 16-bit samples, dst must be 2-byte aligned.
+static inline int head_count16(const uint16_t* dst, int align, int n) {
+    int head = ((align - ((uintptr_t)dst & (align - 1))) & (align - 1)) >> 1;
+    return head < n ? head : n;
+}
+
+static void shl16_sse2(uint16_t* dst, const uint16_t* src, int n, int shift) {
+    const __m128i count = _mm_cvtsi32_si128(shift);
+    int i = head_count16(dst, 16, n);
+
+    if ((uintptr_t)dst & 1) {
+        shl16_c(dst, src, n, shift);
+        return;
+    }
+
+    shl16_c(dst, src, i, shift);
+    for (; i + 8 <= n; i += 8) {
+        __m128i v = _mm_loadu_si128((const __m128i*)(src + i));
+        _mm_stream_si128((__m128i*)(dst + i), _mm_sll_epi16(v, count));
+    }
+    shl16_c(dst + i, src + i, n - i, shift);
+}
+
+static void interleave16_sse2(uint16_t* dst, const uint16_t* src0, const uint16_t* src1, int n, int shift) {
+    const __m128i count = _mm_cvtsi32_si128(shift);
+    int i = head_count16(dst, 16, 2 * n) / 2;
+
+    interleave16_c(dst, src0, src1, i, shift);
+    if (((uintptr_t)(dst + 2 * i) & 15) == 0) {
+        for (; i + 8 <= n; i += 8) {
+            __m128i a = _mm_sll_epi16(_mm_loadu_si128((const __m128i*)(src0 + i)), count);
+            __m128i b = _mm_sll_epi16(_mm_loadu_si128((const __m128i*)(src1 + i)), count);
+            _mm_stream_si128((__m128i*)(dst + 2 * i), _mm_unpacklo_epi16(a, b));
+            _mm_stream_si128((__m128i*)(dst + 2 * i + 8), _mm_unpackhi_epi16(a, b));
+        }
+    }
+    interleave16_c(dst + 2 * i, src0 + i, src1 + i, n - i, shift);
+}
+
+static void dither16_sse2(uint8_t* dst, const uint16_t* src, int n, int shift, const uint16_t* dither) {
+    const __m128i count = _mm_cvtsi32_si128(shift);
+    int i = head_count(dst, 16, n);
+    uint16_t phase[8];
+
+    dither16_c(dst, src, i, shift, dither);
+
+    // Keep the pattern in phase with the sample position.
+    for (int j = 0; j < 8; j++) {
+        phase[j] = dither[(i + j) & 7];
+    }
+    const __m128i d = _mm_loadu_si128((const __m128i*)phase);
+
+    for (; i + 16 <= n; i += 16) {
+        __m128i a = _mm_srl_epi16(_mm_loadu_si128((const __m128i*)(src + i)), count);
+        __m128i b = _mm_srl_epi16(_mm_loadu_si128((const __m128i*)(src + i + 8)), count);
+        a = _mm_srli_epi16(_mm_add_epi16(a, d), 2);
+        b = _mm_srli_epi16(_mm_add_epi16(b, d), 2);
+        _mm_stream_si128((__m128i*)(dst + i), _mm_packus_epi16(a, b));
+    }
+    // Loop steps are a multiple of the period, the tail is still in phase.
+    dither16_c(dst + i, src + i, n - i, shift, phase);
+}
+
+static void fence_sse2() {
+    _mm_sfence();
+}
+
+static const ConvertKernels kKernelsSSE2 = {
+    "sse2", copy_sse2, deinterleave_sse2, interleave_sse2, avg_rows_sse2, avg_2x2_sse2,
+    shl16_sse2, interleave16_sse2, dither16_sse2, fence_sse2
+};
+
+#define AVX2_TARGET __attribute__((target("avx2")))
+
+AVX2_TARGET
+static void copy_avx2(uint8_t* dst, const uint8_t* src, int n) {
+    int i = head_count(dst, 32, n);
+
+    memcpy(dst, src, i);
+    for (; i + 32 <= n; i += 32) {
+        _mm256_stream_si256((__m256i*)(dst + i), _mm256_loadu_si256((const __m256i*)(src + i)));
+    }
+    memcpy(dst + i, src + i, n - i);
+}
+
+AVX2_TARGET
+static void deinterleave_avx2(uint8_t* dst0, uint8_t* dst1, const uint8_t* src, int n) {
+    const __m256i mask = _mm256_set1_epi16(0x00ff);
+    bool stream = ((uintptr_t)dst0 & 31) == ((uintptr_t)dst1 & 31);
+    int i = stream ? head_count(dst0, 32, n) : 0;
+
+    deinterleave_c(dst0, dst1, src, i);
+    for (; i + 32 <= n; i += 32) {
+        __m256i a = _mm256_loadu_si256((const __m256i*)(src + 2 * i));
+        __m256i b = _mm256_loadu_si256((const __m256i*)(src + 2 * i + 32));
+        __m256i u = _mm256_packus_epi16(_mm256_and_si256(a, mask), _mm256_and_si256(b, mask));
+        __m256i v = _mm256_packus_epi16(_mm256_srli_epi16(a, 8), _mm256_srli_epi16(b, 8));
+        // packus operates on 128-bit lanes, restore sample order.
+        u = _mm256_permute4x64_epi64(u, 0xd8);
+        v = _mm256_permute4x64_epi64(v, 0xd8);
+        if (stream) {
+            _mm256_stream_si256((__m256i*)(dst0 + i), u);
+            _mm256_stream_si256((__m256i*)(dst1 + i), v);
+        } else {
+            _mm256_storeu_si256((__m256i*)(dst0 + i), u);
+            _mm256_storeu_si256((__m256i*)(dst1 + i), v);
+        }
+    }
+    deinterleave_c(dst0 + i, dst1 + i, src + 2 * i, n - i);
+}
+
+AVX2_TARGET
+static void interleave_avx2(uint8_t* dst, const uint8_t* src0, const uint8_t* src1, int n) {
+    int i = head_count(dst, 32, 2 * n) / 2;
+
+    interleave_c(dst, src0, src1, i);
+    if (((uintptr_t)(dst + 2 * i) & 31) == 0) {
+        for (; i + 32 <= n; i += 32) {
+            __m256i a = _mm256_loadu_si256((const __m256i*)(src0 + i));
+            __m256i b = _mm256_loadu_si256((const __m256i*)(src1 + i));
+            __m256i lo = _mm256_unpacklo_epi8(a, b);
+            __m256i hi = _mm256_unpackhi_epi8(a, b);
+            // unpack operates on 128-bit lanes, restore sample order.
+            _mm256_stream_si256((__m256i*)(dst + 2 * i), _mm256_permute2x128_si256(lo, hi, 0x20));
+            _mm256_stream_si256((__m256i*)(dst + 2 * i + 32), _mm256_permute2x128_si256(lo, hi, 0x31));
+        }
+    }
+    interleave_c(dst + 2 * i, src0 + i, src1 + i, n - i);
+}
+
+AVX2_TARGET
+static void avg_rows_avx2(uint8_t* dst, const uint8_t* src0, const uint8_t* src1, int n) {
+    int i = head_count(dst, 32, n);
+
+    avg_rows_c(dst, src0, src1, i);
+    for (; i + 32 <= n; i += 32) {
+        __m256i a = _mm256_loadu_si256((const __m256i*)(src0 + i));
+        __m256i b = _mm256_loadu_si256((const __m256i*)(src1 + i));
+        _mm256_stream_si256((__m256i*)(dst + i), _mm256_avg_epu8(a, b));
+    }
+    avg_rows_c(dst + i, src0 + i, src1 + i, n - i);
+}
+
+AVX2_TARGET
+static inline __m256i hadd_pairs_avx2(__m256i v) {
+    return _mm256_add_epi16(_mm256_and_si256(v, _mm256_set1_epi16(0x00ff)), _mm256_srli_epi16(v, 8));
+}
+
+AVX2_TARGET
+static void avg_2x2_avx2(uint8_t* dst, const uint8_t* src0, const uint8_t* src1, int n) {
+    const __m256i round = _mm256_set1_epi16(2);
+    int i = head_count(dst, 32, n);
+
+    avg_2x2_c(dst, src0, src1, i);
+    for (; i + 32 <= n; i += 32) {
+        __m256i a = _mm256_add_epi16(hadd_pairs_avx2(_mm256_loadu_si256((const __m256i*)(src0 + 2 * i))),
+                                     hadd_pairs_avx2(_mm256_loadu_si256((const __m256i*)(src1 + 2 * i))));
+        __m256i b = _mm256_add_epi16(hadd_pairs_avx2(_mm256_loadu_si256((const __m256i*)(src0 + 2 * i + 32))),
+                                     hadd_pairs_avx2(_mm256_loadu_si256((const __m256i*)(src1 + 2 * i + 32))));
+        a = _mm256_srli_epi16(_mm256_add_epi16(a, round), 2);
+        b = _mm256_srli_epi16(_mm256_add_epi16(b, round), 2);
+        // packus operates on 128-bit lanes, restore sample order.
+        _mm256_stream_si256((__m256i*)(dst + i),
+                            _mm256_permute4x64_epi64(_mm256_packus_epi16(a, b), 0xd8));
+    }
+    avg_2x2_c(dst + i, src0 + 2 * i, src1 + 2 * i, n - i);
+}
+
+// High bit depth kernels are bound by the 16-bit loads, SSE2 is enough.
+static const ConvertKernels kKernelsAVX2 = {
+    "avx2", copy_avx2, deinterleave_avx2, interleave_avx2, avg_rows_avx2, avg_2x2_avx2,
+    shl16_sse2, interleave16_sse2, dither16_sse2, fence_sse2
+};
+
+#endif // HAVE_X86_KERNELS
+
+#ifdef HAVE_NEON_KERNELS
+
+static inline void store_neon(uint8_t* dst, uint8x16_t v) {
+#if __has_builtin(__builtin_nontemporal_store)
+    __builtin_nontemporal_store(v, (uint8x16_t*)dst);
+#else
+    vst1q_u8(dst, v);
+#endif
+}
+
+static void copy_neon(uint8_t* dst, const uint8_t* src, int n) {
+    int i = 0;
+
+    for (; i + 16 <= n; i += 16) {
+        store_neon(dst + i, vld1q_u8(src + i));
+    }
+    memcpy(dst + i, src + i, n - i);
+}
+
+static void deinterleave_neon(uint8_t* dst0, uint8_t* dst1, const uint8_t* src, int n) {
+    int i = 0;
+
+    for (; i + 16 <= n; i += 16) {
+        uint8x16x2_t uv = vld2q_u8(src + 2 * i);
+        store_neon(dst0 + i, uv.val[0]);
+        store_neon(dst1 + i, uv.val[1]);
+    }
+    deinterleave_c(dst0 + i, dst1 + i, src + 2 * i, n - i);
+}
+
+static void interleave_neon(uint8_t* dst, const uint8_t* src0, const uint8_t* src1, int n) {
+    int i = 0;
+
+    for (; i + 16 <= n; i += 16) {
+        uint8x16x2_t uv = vzipq_u8(vld1q_u8(src0 + i), vld1q_u8(src1 + i));
+        store_neon(dst + 2 * i, uv.val[0]);
+        store_neon(dst + 2 * i + 16, uv.val[1]);
+    }
+    interleave_c(dst + 2 * i, src0 + i, src1 + i, n - i);
+}
+
+static void avg_rows_neon(uint8_t* dst, const uint8_t* src0, const uint8_t* src1, int n) {
+    int i = 0;
+
+    for (; i + 16 <= n; i += 16) {
+        store_neon(dst + i, vrhaddq_u8(vld1q_u8(src0 + i), vld1q_u8(src1 + i)));
+    }
+    avg_rows_c(dst + i, src0 + i, src1 + i, n - i);
+}
+
+static void avg_2x2_neon(uint8_t* dst, const uint8_t* src0, const uint8_t* src1, int n) {
+    int i = 0;
+
+    for (; i + 16 <= n; i += 16) {
+        uint8x16x2_t a = vld2q_u8(src0 + 2 * i);
+        uint8x16x2_t b = vld2q_u8(src1 + 2 * i);
+        // Sum of the 4 samples on 16 bits, then round.
+        uint16x8_t lo = vaddl_u8(vget_low_u8(a.val[0]), vget_low_u8(a.val[1]));
+        uint16x8_t hi = vaddl_u8(vget_high_u8(a.val[0]), vget_high_u8(a.val[1]));
+        lo = vaddw_u8(vaddw_u8(lo, vget_low_u8(b.val[0])), vget_low_u8(b.val[1]));
+        hi = vaddw_u8(vaddw_u8(hi, vget_high_u8(b.val[0])), vget_high_u8(b.val[1]));
+        store_neon(dst + i, vcombine_u8(vrshrn_n_u16(lo, 2), vrshrn_n_u16(hi, 2)));
+    }
+    avg_2x2_c(dst + i, src0 + 2 * i, src1 + 2 * i, n - i);
+}
+
+static void shl16_neon(uint16_t* dst, const uint16_t* src, int n, int shift) {
+    const int16x8_t count = vdupq_n_s16(shift);
+    int i = 0;
+
+    for (; i + 8 <= n; i += 8) {
+        store_neon((uint8_t*)(dst + i), vreinterpretq_u8_u16(vshlq_u16(vld1q_u16(src + i), count)));
+    }
+    shl16_c(dst + i, src + i, n - i, shift);
+}
+
+static void interleave16_neon(uint16_t* dst, const uint16_t* src0, const uint16_t* src1, int n, int shift) {
+    const int16x8_t count = vdupq_n_s16(shift);
+    int i = 0;
+
+    for (; i + 8 <= n; i += 8) {
+        uint16x8x2_t uv = vzipq_u16(vshlq_u16(vld1q_u16(src0 + i), count),
+                                    vshlq_u16(vld1q_u16(src1 + i), count));
+        store_neon((uint8_t*)(dst + 2 * i), vreinterpretq_u8_u16(uv.val[0]));
+        store_neon((uint8_t*)(dst + 2 * i + 8), vreinterpretq_u8_u16(uv.val[1]));
+    }
+    interleave16_c(dst + 2 * i, src0 + i, src1 + i, n - i, shift);
+}
+
+static void dither16_neon(uint8_t* dst, const uint16_t* src, int n, int shift, const uint16_t* dither) {
+    // Negative counts shift right.
+    const int16x8_t count = vdupq_n_s16(-shift);
+    const uint16x8_t d = vld1q_u16(dither);
+    int i = 0;
+
+    for (; i + 16 <= n; i += 16) {
+        uint16x8_t a = vaddq_u16(vshlq_u16(vld1q_u16(src + i), count), d);
+        uint16x8_t b = vaddq_u16(vshlq_u16(vld1q_u16(src + i + 8), count), d);
+        // Saturating narrow clamps to 255.
+        store_neon(dst + i, vcombine_u8(vqshrn_n_u16(a, 2), vqshrn_n_u16(b, 2)));
+    }
+    dither16_c(dst + i, src + i, n - i, shift, dither);
+}
+
+static const ConvertKernels kKernelsNEON = {
+    "neon", copy_neon, deinterleave_neon, interleave_neon, avg_rows_neon, avg_2x2_neon,
+    shl16_neon, interleave16_neon, dither16_neon, fence_c
+};
+
+#endif // HAVE_NEON_KERNELS
+
+static const ConvertKernels* selectKernels() {
+    int flags = av_get_cpu_flags();
+    const ConvertKernels* kernels = &kKernelsC;
+
+#ifdef HAVE_X86_KERNELS
+    if (flags & AV_CPU_FLAG_AVX2) {
+        kernels = &kKernelsAVX2;
+    } else if (flags & AV_CPU_FLAG_SSE2) {
+        kernels = &kKernelsSSE2;
+    }
+#endif
+#ifdef HAVE_NEON_KERNELS
+    if (flags & AV_CPU_FLAG_NEON) {
+        kernels = &kKernelsNEON;
+    }
+#endif
+    (void)flags;
+
+    ALOGI("ffmpeg_convert: using %s kernels", kernels->name);
+    return kernels;
+}
+
+static const ConvertKernels* getKernels() {
+    static const ConvertKernels* kernels = selectKernels();
+    return kernels;
+}
+
+//////////////////////////////////////////////////////////////////////////////////
+// plane helpers
+//////////////////////////////////////////////////////////////////////////////////
+
+static void copy_plane(const ConvertKernels* k,
+        uint8_t* dst, int dst_linesize, const uint8_t* src, int src_linesize,
+        int width, int height) {
+    for (int y = 0; y < height; y++) {
+        k->copy(dst + y * dst_linesize, src + y * src_linesize, width);
+    }
+}
+
+// Semi-planar chroma (UVUV...) to two separate planes.
+static void deinterleave_plane(const ConvertKernels* k,
+        uint8_t* dst0, int dst0_linesize, uint8_t* dst1, int dst1_linesize,
+        const uint8_t* src, int src_linesize, int width, int height) {
+    for (int y = 0; y < height; y++) {
+        k->deinterleave(dst0 + y * dst0_linesize, dst1 + y * dst1_linesize,
+                        src + y * src_linesize, width);
+    }
+}
+
+// Two separate chroma planes to semi-planar (UVUV...).
+static void interleave_plane(const ConvertKernels* k,
+        uint8_t* dst, int dst_linesize, const uint8_t* src0, int src0_linesize,
+        const uint8_t* src1, int src1_linesize, int width, int height) {
+    for (int y = 0; y < height; y++) {
+        k->interleave(dst + y * dst_linesize, src0 + y * src0_linesize,
+                      src1 + y * src1_linesize, width);
+    }
+}
+
+// 4:2:2 chroma to 4:2:0: average pairs of rows.
+static void decimate_plane_v(const ConvertKernels* k,
+        uint8_t* dst, int dst_linesize, const uint8_t* src, int src_linesize,
+        int width, int height) {
+    int dst_height = (height + 1) >> 1;
+
+    for (int y = 0; y < dst_height; y++) {
+        const uint8_t* src0 = src + 2 * y * src_linesize;
+        const uint8_t* src1 = (2 * y + 1 < height) ? src0 + src_linesize : src0;
+        k->avg_rows(dst + y * dst_linesize, src0, src1, width);
+    }
+}
+
+// 4:4:4 chroma to 4:2:0: average 2x2 blocks.
+static void decimate_plane_hv(const ConvertKernels* k,
+        uint8_t* dst, int dst_linesize, const uint8_t* src, int src_linesize,
+        int width, int height) {
+    int dst_width = width >> 1;
+    int dst_height = (height + 1) >> 1;
+
+    for (int y = 0; y < dst_height; y++) {
+        const uint8_t* src0 = src + 2 * y * src_linesize;
+        const uint8_t* src1 = (2 * y + 1 < height) ? src0 + src_linesize : src0;
+        uint8_t* d = dst + y * dst_linesize;
+
+        k->avg_2x2(d, src0, src1, dst_width);
+        if (width & 1) {
+            // Last column has no right neighbour.
+            d[dst_width] = (src0[width - 1] + src1[width - 1] + 1) >> 1;
+        }
+    }
+}
+
+//////////////////////////////////////////////////////////////////////////////////
+// frame conversion
+//////////////////////////////////////////////////////////////////////////////////
+
+// Source rows handed to the conversion functions: a whole frame or a band.
+struct ConvertImage {
+    const uint8_t* data[4];
+    int linesize[4];
+    int width;
+    int height;
+    int format;
+};
+
+// Ordered 2x2 dither, rows alternate between both patterns. Interleaved
+// chroma uses the same pattern on pairs of samples.
+static const uint16_t kDither[2][8] = {
+    { 0, 2, 0, 2, 0, 2, 0, 2 },
+    { 3, 1, 3, 1, 3, 1, 3, 1 },
+};
+static const uint16_t kDitherPairs[2][8] = {
+    { 0, 0, 2, 2, 0, 0, 2, 2 },
+    { 3, 3, 1, 1, 3, 3, 1, 1 },
+};
+
+bool ffmpeg_convert_supported(enum AVPixelFormat src_fmt, enum AVPixelFormat dst_fmt) {
+    switch (dst_fmt) {
+        case AV_PIX_FMT_YUV420P:
+            switch (src_fmt) {
+                case AV_PIX_FMT_YUV420P:
+                case AV_PIX_FMT_YUVJ420P:
+                case AV_PIX_FMT_NV12:
+                case AV_PIX_FMT_NV21:
+                case AV_PIX_FMT_YUV422P:
+                case AV_PIX_FMT_YUVJ422P:
+                case AV_PIX_FMT_YUV444P:
+                case AV_PIX_FMT_YUVJ444P:
+                case AV_PIX_FMT_YUV420P10:
+                case AV_PIX_FMT_P010:
+                    return true;
+                default:
+                    return false;
+            }
+        case AV_PIX_FMT_NV12:
+            return src_fmt == AV_PIX_FMT_YUV420P ||
+                   src_fmt == AV_PIX_FMT_YUVJ420P ||
+                   src_fmt == AV_PIX_FMT_NV12 ||
+                   src_fmt == AV_PIX_FMT_P010;
+        case AV_PIX_FMT_NV21:
+            return src_fmt == AV_PIX_FMT_YUV420P ||
+                   src_fmt == AV_PIX_FMT_YUVJ420P ||
+                   src_fmt == AV_PIX_FMT_NV21;
+        case AV_PIX_FMT_P010:
+            return src_fmt == AV_PIX_FMT_YUV420P10 ||
+                   src_fmt == AV_PIX_FMT_P010;
+        default:
+            return false;
+    }
+}
+
+static inline const uint16_t* row16(const uint8_t* data, int linesize, int y) {
+    return (const uint16_t*)(data + y * linesize);
+}
+
+// 10-bit sources (planar, or P010 from the HW path): repack to P010, or
+// dither down to 8-bit YUV 4:2:0. The dither pattern follows the frame
+// rows, band_y is the first row of the band in the frame.
+static void convert_high_depth(const ConvertKernels* k, const ConvertImage* src,
+        uint8_t* const dst[4], const int dst_linesize[4], enum AVPixelFormat dst_fmt, int band_y) {
+    int width = src->width;
+    int height = src->height;
+    int cwidth = (width + 1) >> 1;
+    int cheight = (height + 1) >> 1;
+    bool p010 = src->format == AV_PIX_FMT_P010;
+    // P010 holds the samples in the high bits.
+    int shift = p010 ? 6 : 0;
+
+    if (dst_fmt == AV_PIX_FMT_P010) {
+        if (p010) {
+            copy_plane(k, dst[0], dst_linesize[0], src->data[0], src->linesize[0], 2 * width, height);
+            copy_plane(k, dst[1], dst_linesize[1], src->data[1], src->linesize[1], 4 * cwidth, cheight);
+            return;
+        }
+        for (int y = 0; y < height; y++) {
+            k->shl16((uint16_t*)(dst[0] + y * dst_linesize[0]),
+                     row16(src->data[0], src->linesize[0], y), width, 6);
+        }
+        for (int y = 0; y < cheight; y++) {
+            k->interleave16((uint16_t*)(dst[1] + y * dst_linesize[1]),
+                            row16(src->data[1], src->linesize[1], y),
+                            row16(src->data[2], src->linesize[2], y), cwidth, 6);
+        }
+        return;
+    }
+
+    for (int y = 0; y < height; y++) {
+        k->dither16(dst[0] + y * dst_linesize[0],
+                    row16(src->data[0], src->linesize[0], y), width, shift, kDither[(band_y + y) & 1]);
+    }
+
+    for (int y = 0; y < cheight; y++) {
+        int parity = ((band_y >> 1) + y) & 1;
+
+        if (! p010) {
+            // Planar to planar.
+            k->dither16(dst[1] + y * dst_linesize[1],
+                        row16(src->data[1], src->linesize[1], y), cwidth, shift, kDither[parity]);
+            k->dither16(dst[2] + y * dst_linesize[2],
+                        row16(src->data[2], src->linesize[2], y), cwidth, shift, kDither[parity]);
+        } else if (dst_fmt == AV_PIX_FMT_NV12) {
+            k->dither16(dst[1] + y * dst_linesize[1],
+                        row16(src->data[1], src->linesize[1], y), 2 * cwidth, shift, kDitherPairs[parity]);
+        } else {
+            // Interleaved to planar, through a small buffer that stays in L1
+            // (dithered with regular stores, it is read back right away).
+            const int kChunk = 256;
+            uint8_t tmp[2 * kChunk];
+
+            for (int x = 0; x < cwidth; x += kChunk) {
+                int n = cwidth - x < kChunk ? cwidth - x : kChunk;
+                dither16_c(tmp, row16(src->data[1], src->linesize[1], y) + 2 * x, 2 * n,
+                           shift, kDitherPairs[parity]);
+                k->deinterleave(dst[1] + y * dst_linesize[1] + x, dst[2] + y * dst_linesize[2] + x,
+                                tmp, n);
+            }
+        }
+    }
+}
+
+// Destination is planar YUV 4:2:0.
+static void convert_to_yuv420p(const ConvertKernels* k, const ConvertImage* src,
+        uint8_t* const dst[4], const int dst_linesize[4]) {
+    int width = src->width;
+    int height = src->height;
+    int cwidth = (width + 1) >> 1;
+    int cheight = (height + 1) >> 1;
+
+    copy_plane(k, dst[0], dst_linesize[0], src->data[0], src->linesize[0], width, height);
+
+    switch (src->format) {
+        case AV_PIX_FMT_YUV420P:
+        case AV_PIX_FMT_YUVJ420P:
+            copy_plane(k, dst[1], dst_linesize[1], src->data[1], src->linesize[1], cwidth, cheight);
+            copy_plane(k, dst[2], dst_linesize[2], src->data[2], src->linesize[2], cwidth, cheight);
+            break;
+        case AV_PIX_FMT_NV12:
+            deinterleave_plane(k, dst[1], dst_linesize[1], dst[2], dst_linesize[2],
+                               src->data[1], src->linesize[1], cwidth, cheight);
+            break;
+        case AV_PIX_FMT_NV21:
+            deinterleave_plane(k, dst[2], dst_linesize[2], dst[1], dst_linesize[1],
+                               src->data[1], src->linesize[1], cwidth, cheight);
+            break;
+        case AV_PIX_FMT_YUV422P:
+        case AV_PIX_FMT_YUVJ422P:
+            decimate_plane_v(k, dst[1], dst_linesize[1], src->data[1], src->linesize[1], cwidth, height);
+            decimate_plane_v(k, dst[2], dst_linesize[2], src->data[2], src->linesize[2], cwidth, height);
+            break;
+        case AV_PIX_FMT_YUV444P:
+        case AV_PIX_FMT_YUVJ444P:
+            decimate_plane_hv(k, dst[1], dst_linesize[1], src->data[1], src->linesize[1], width, height);
+            decimate_plane_hv(k, dst[2], dst_linesize[2], src->data[2], src->linesize[2], width, height);
+            break;
+        default:
+            break;
+    }
+}
+
+// Destination is semi-planar YUV 4:2:0, dst[1] holds the interleaved chroma.
+static void convert_to_semiplanar(const ConvertKernels* k, const ConvertImage* src,
+        uint8_t* const dst[4], const int dst_linesize[4], enum AVPixelFormat dst_fmt) {
+    int width = src->width;
+    int height = src->height;
+    int cwidth = (width + 1) >> 1;
+    int cheight = (height + 1) >> 1;
+
+    copy_plane(k, dst[0], dst_linesize[0], src->data[0], src->linesize[0], width, height);
+
+    if (src->format == dst_fmt) {
+        copy_plane(k, dst[1], dst_linesize[1], src->data[1], src->linesize[1], 2 * cwidth, cheight);
+    } else if (dst_fmt == AV_PIX_FMT_NV12) {
+        interleave_plane(k, dst[1], dst_linesize[1], src->data[1], src->linesize[1],
+                         src->data[2], src->linesize[2], cwidth, cheight);
+    } else {
+        interleave_plane(k, dst[1], dst_linesize[1], src->data[2], src->linesize[2],
+                         src->data[1], src->linesize[1], cwidth, cheight);
+    }
+}
+
+int ffmpeg_convert_slice(const AVFrame* frame,
+        uint8_t* const dst[4], const int dst_linesize[4], enum AVPixelFormat dst_fmt,
+        int y, int h) {
+    const ConvertKernels* k = getKernels();
+    enum AVPixelFormat src_fmt = (enum AVPixelFormat)frame->format;
+    // Row of the band in the source chroma planes.
+    int cy = (src_fmt == AV_PIX_FMT_YUV422P || src_fmt == AV_PIX_FMT_YUVJ422P ||
+              src_fmt == AV_PIX_FMT_YUV444P || src_fmt == AV_PIX_FMT_YUVJ444P) ? y : y >> 1;
+    ConvertImage src;
+    uint8_t* band[4];
+
+    if (! ffmpeg_convert_supported(src_fmt, dst_fmt) || (y & 1) || y + h > frame->height) {
+        return AVERROR(ENOSYS);
+    }
+
+    src.width = frame->width;
+    src.height = h;
+    src.format = src_fmt;
+    for (int i = 0; i < 3; i++) {
+        int sy = (i == 0) ? y : cy;
+        src.data[i] = frame->data[i] ? frame->data[i] + sy * frame->linesize[i] : NULL;
+        src.linesize[i] = frame->linesize[i];
+        // Destination is always 4:2:0.
+        band[i] = dst[i] ? dst[i] + ((i == 0) ? y : y >> 1) * dst_linesize[i] : NULL;
+    }
+    src.data[3] = NULL;
+    src.linesize[3] = 0;
+    band[3] = NULL;
+
+    if (src_fmt == AV_PIX_FMT_YUV420P10 || src_fmt == AV_PIX_FMT_P010) {
+        convert_high_depth(k, &src, band, dst_linesize, dst_fmt, y);
+    } else if (dst_fmt == AV_PIX_FMT_YUV420P) {
+        convert_to_yuv420p(k, &src, band, dst_linesize);
+    } else {
+        convert_to_semiplanar(k, &src, band, dst_linesize, dst_fmt);
+    }
+
+    // Make the streaming stores of this thread visible before the buffer
+    // is handed over.
+    k->fence();
+
+    return 0;
+}
+
+int ffmpeg_convert_frame(const AVFrame* frame,
+        uint8_t* const dst[4], const int dst_linesize[4], enum AVPixelFormat dst_fmt) {
+    return ffmpeg_convert_slice(frame, dst, dst_linesize, dst_fmt, 0, frame->height);
+}
+
+}  // namespace android
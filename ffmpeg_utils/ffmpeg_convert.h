@@ -0,0 +1,50 @@
+/*
+ * Copyright (C) 2024 KonstaKANG
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef FFMPEG_CONVERT_H_
+
+#define FFMPEG_CONVERT_H_
+
+#include "ffmpeg_utils.h"
+
+namespace android {
+
+//////////////////////////////////////////////////////////////////////////////////
+// Same-size pixel format conversion kernels, used in place of swscale for the
+// common decoder output formats, 10-bit ones included (repacked to P010 or
+// dithered to 8 bits). Implementations are selected at runtime from the CPU
+// features (NEON, SSE2, AVX2, scalar fallback).
+//////////////////////////////////////////////////////////////////////////////////
+
+// Returns true if a dedicated kernel exists for src_fmt => dst_fmt.
+bool ffmpeg_convert_supported(enum AVPixelFormat src_fmt, enum AVPixelFormat dst_fmt);
+
+// Converts the whole frame into the destination planes, which must have the
+// same dimensions as the frame. For semi-planar destinations (NV12, NV21, P010),
+// dst[1] is the interleaved chroma plane. Returns 0 on success, or
+// AVERROR(ENOSYS) if the conversion is not supported.
+int ffmpeg_convert_frame(const AVFrame* frame,
+        uint8_t* const dst[4], const int dst_linesize[4], enum AVPixelFormat dst_fmt);
+
+// Converts rows [y, y + h) of the frame, y must be even. Bands can be
+// converted concurrently from different threads.
+int ffmpeg_convert_slice(const AVFrame* frame,
+        uint8_t* const dst[4], const int dst_linesize[4], enum AVPixelFormat dst_fmt,
+        int y, int h);
+
+}  // namespace android
+
+#endif  // FFMPEG_CONVERT_H_
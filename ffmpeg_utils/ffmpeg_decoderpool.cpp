@@ -0,0 +1,187 @@
+/*
+ * Copyright (C) 2024 KonstaKANG
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "FFMPEG"
+#include <utils/Log.h>
+
+#include <cutils/properties.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <algorithm>
+
+#include "ffmpeg_budget.h"
+#include "ffmpeg_decoderpool.h"
+#include "ffmpeg_hwaccel.h"
+
+namespace android {
+
+static constexpr int kMaxCapacity = 4;
+// Thumbnails are requested in bursts, a decoder idle for longer is unlikely
+// to be adopted.
+static constexpr std::chrono::seconds kIdleTimeout(10);
+static constexpr std::chrono::seconds kCheckInterval(1);
+// Share of the last 10 seconds some tasks were stalled on memory, in percent.
+static constexpr float kPressureThreshold = 10.0f;
+
+FFmpegDecoderPool& FFmpegDecoderPool::instance() {
+    static FFmpegDecoderPool* sInstance = new FFmpegDecoderPool();
+    return *sInstance;
+}
+
+FFmpegDecoderPool::FFmpegDecoderPool()
+    : mBytes(0),
+      mCapacity(std::clamp(property_get_int32("persist.ffmpeg_codec2.decoder_pool", 0), 0, kMaxCapacity)),
+      mHits(0),
+      mMisses(0) {
+}
+
+void FFmpegDecoderPool::freeDecoders(std::deque<Entry>& entries) {
+    for (auto& entry : entries) {
+        ffmpeg_hwaccel_deinit(entry.decoder.ctx);
+        avcodec_free_context(&entry.decoder.ctx);
+        deInitFFmpeg();
+    }
+    entries.clear();
+}
+
+// Pressure stall information, the signal lmkd kills processes on.
+bool FFmpegDecoderPool::isUnderPressure() {
+    FILE* f = fopen("/proc/pressure/memory", "r");
+    float avg10 = 0;
+
+    if (! f) {
+        return false;
+    }
+    if (fscanf(f, "some avg10=%f", &avg10) != 1) {
+        avg10 = 0;
+    }
+    fclose(f);
+    return avg10 >= kPressureThreshold;
+}
+
+void FFmpegDecoderPool::put(const FFmpegPooledDecoder& decoder) {
+    std::deque<Entry> evicted;
+
+    evicted.push_back(Entry{ decoder, std::chrono::steady_clock::now() });
+
+    {
+        std::lock_guard<std::mutex> lock(mLock);
+        FFmpegMemoryBudget& budget = FFmpegMemoryBudget::instance();
+        size_t limit = budget.getLimit();
+
+        // Running sessions come first.
+        if (mCapacity > 0 && (! limit || budget.getTotalUsage() + mBytes + decoder.bytes <= limit)) {
+            auto sameCodec = [&decoder](const Entry& e) {
+                return e.decoder.ctx->codec_id == decoder.ctx->codec_id;
+            };
+
+            if (std::count_if(mEntries.begin(), mEntries.end(), sameCodec) >= mCapacity) {
+                auto oldest = std::find_if(mEntries.begin(), mEntries.end(), sameCodec);
+
+                mBytes -= oldest->decoder.bytes;
+                evicted.push_back(std::move(*oldest));
+                mEntries.erase(oldest);
+            }
+            mEntries.push_back(std::move(evicted.front()));
+            evicted.pop_front();
+            mBytes += decoder.bytes;
+
+            if (! mReaper.joinable()) {
+                mReaper = std::thread(&FFmpegDecoderPool::reaperLoop, this);
+            }
+            mCond.notify_all();
+
+            ALOGD("FFmpegDecoderPool: keeping decoder(%s), %zu pooled",
+                  avcodec_get_name(decoder.ctx->codec_id), mEntries.size());
+        }
+    }
+    freeDecoders(evicted);
+}
+
+bool FFmpegDecoderPool::take(enum AVCodecID codec_id, FFmpegPooledDecoder* decoder) {
+    std::lock_guard<std::mutex> lock(mLock);
+
+    for (auto it = mEntries.rbegin(); it != mEntries.rend(); it++) {
+        if (it->decoder.ctx->codec_id == codec_id) {
+            *decoder = it->decoder;
+            mBytes -= it->decoder.bytes;
+            mEntries.erase(std::next(it).base());
+            mHits++;
+            return true;
+        }
+    }
+    mMisses++;
+    return false;
+}
+
+void FFmpegDecoderPool::trim() {
+    std::deque<Entry> entries;
+
+    {
+        std::lock_guard<std::mutex> lock(mLock);
+
+        entries.swap(mEntries);
+        mBytes = 0;
+    }
+    if (! entries.empty()) {
+        ALOGD("FFmpegDecoderPool: freeing %zu decoders, hits = %" PRIu64 ", misses = %" PRIu64,
+              entries.size(), mHits.load(), mMisses.load());
+    }
+    freeDecoders(entries);
+}
+
+size_t FFmpegDecoderPool::getBytes() {
+    std::lock_guard<std::mutex> lock(mLock);
+
+    return mBytes;
+}
+
+void FFmpegDecoderPool::reaperLoop() {
+    std::unique_lock<std::mutex> lock(mLock);
+
+    for (;;) {
+        if (mEntries.empty()) {
+            mCond.wait(lock);
+            continue;
+        }
+        mCond.wait_for(lock, kCheckInterval);
+
+        lock.unlock();
+        bool pressure = isUnderPressure();
+        lock.lock();
+
+        std::deque<Entry> expired;
+        auto now = std::chrono::steady_clock::now();
+
+        while (! mEntries.empty() && (pressure || now - mEntries.front().released >= kIdleTimeout)) {
+            mBytes -= mEntries.front().decoder.bytes;
+            expired.push_back(std::move(mEntries.front()));
+            mEntries.pop_front();
+        }
+        if (expired.empty()) {
+            continue;
+        }
+
+        ALOGD("FFmpegDecoderPool: freeing %zu decoders (%s), hits = %" PRIu64 ", misses = %" PRIu64,
+              expired.size(), pressure ? "memory pressure" : "idle",
+              mHits.load(), mMisses.load());
+        lock.unlock();
+        freeDecoders(expired);
+        lock.lock();
+    }
+}
+
+}  // namespace android
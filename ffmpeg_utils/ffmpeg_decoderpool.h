@@ -0,0 +1,96 @@
+/*
+ * Copyright (C) 2024 KonstaKANG
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef FFMPEG_DECODERPOOL_H_
+
+#define FFMPEG_DECODERPOOL_H_
+
+#include <stdint.h>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+
+#include "ffmpeg_probe.h"
+
+namespace android {
+
+//////////////////////////////////////////////////////////////////////////////////
+// Opened decoders of released components, kept for the next component of
+// the same codec. Thumbnail generation creates and releases components in a
+// row, adopting a decoder saves its initialization.
+//
+// A pooled decoder holds the initFFmpeg() reference of the component that
+// released it. Decoders are freed once idle for a few seconds, when the
+// system is under memory pressure, or on trim().
+//////////////////////////////////////////////////////////////////////////////////
+struct FFmpegPooledDecoder {
+    // Opened and flushed.
+    AVCodecContext* ctx;
+    FFmpegStreamInfo stream_info;
+    bool stream_info_probed;
+    bool low_latency;
+    // Memory held by the decoder, 0 if unknown.
+    size_t bytes;
+};
+
+class FFmpegDecoderPool {
+public:
+    static FFmpegDecoderPool& instance();
+
+    // Decoders kept per codec, 0 if the pool is disabled.
+    int getCapacity() const { return mCapacity; }
+
+    // Takes ownership of the decoder, which is freed if it cannot be kept.
+    void put(const FFmpegPooledDecoder& decoder);
+    // Most recently released decoder of the codec. Counted as a hit or a
+    // miss.
+    bool take(enum AVCodecID codec_id, FFmpegPooledDecoder* decoder);
+    // Frees all the pooled decoders.
+    void trim();
+
+    size_t getBytes();
+    uint64_t getHits() const { return mHits; }
+    uint64_t getMisses() const { return mMisses; }
+
+private:
+    struct Entry {
+        FFmpegPooledDecoder decoder;
+        std::chrono::steady_clock::time_point released;
+    };
+
+    FFmpegDecoderPool();
+
+    static void freeDecoders(std::deque<Entry>& entries);
+    static bool isUnderPressure();
+    void reaperLoop();
+
+    std::mutex mLock;
+    std::condition_variable mCond;
+    // Oldest first.
+    std::deque<Entry> mEntries;
+    size_t mBytes;
+    const int mCapacity;
+    std::atomic<uint64_t> mHits;
+    std::atomic<uint64_t> mMisses;
+    std::thread mReaper;
+};
+
+}  // namespace android
+
+#endif  // FFMPEG_DECODERPOOL_H_
@@ -0,0 +1,90 @@
+/*
+ * Copyright (C) 2024 KonstaKANG
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "FFMPEG"
+#include <utils/Log.h>
+
+#include "ffmpeg_framequeue.h"
+
+namespace android {
+
+FFmpegFrameQueue::FFmpegFrameQueue(size_t capacity)
+    : mTail(0),
+      mHead(0) {
+    size_t size = 1;
+
+    while (size < capacity) {
+        size <<= 1;
+    }
+    mFrames.resize(size);
+    mMask = size - 1;
+
+    // Slots are allocated once, only references move around afterwards.
+    for (auto& frame : mFrames) {
+        frame = av_frame_alloc();
+        LOG_ALWAYS_FATAL_IF(! frame, "FFmpegFrameQueue: oom for frame");
+    }
+}
+
+FFmpegFrameQueue::~FFmpegFrameQueue() {
+    for (auto& frame : mFrames) {
+        av_frame_free(&frame);
+    }
+}
+
+bool FFmpegFrameQueue::push(AVFrame* src) {
+    size_t tail = mTail.load(std::memory_order_relaxed);
+
+    if (tail - mHead.load(std::memory_order_acquire) > mMask) {
+        return false;
+    }
+    av_frame_move_ref(mFrames[tail & mMask], src);
+    mTail.store(tail + 1, std::memory_order_release);
+
+    return true;
+}
+
+bool FFmpegFrameQueue::pop(AVFrame* dst) {
+    size_t head = mHead.load(std::memory_order_relaxed);
+
+    if (head == mTail.load(std::memory_order_acquire)) {
+        return false;
+    }
+    av_frame_unref(dst);
+    av_frame_move_ref(dst, mFrames[head & mMask]);
+    mHead.store(head + 1, std::memory_order_release);
+
+    return true;
+}
+
+void FFmpegFrameQueue::clear() {
+    size_t head = mHead.load(std::memory_order_relaxed);
+
+    while (head != mTail.load(std::memory_order_acquire)) {
+        av_frame_unref(mFrames[head & mMask]);
+        mHead.store(++head, std::memory_order_release);
+    }
+}
+
+bool FFmpegFrameQueue::empty() const {
+    return mHead.load(std::memory_order_acquire) == mTail.load(std::memory_order_acquire);
+}
+
+bool FFmpegFrameQueue::full() const {
+    return mTail.load(std::memory_order_acquire) - mHead.load(std::memory_order_acquire) > mMask;
+}
+
+}  // namespace android
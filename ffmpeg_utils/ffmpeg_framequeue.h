@@ -0,0 +1,63 @@
+/*
+ * Copyright (C) 2024 KonstaKANG
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef FFMPEG_FRAMEQUEUE_H_
+
+#define FFMPEG_FRAMEQUEUE_H_
+
+#include <atomic>
+#include <vector>
+
+#include "ffmpeg_utils.h"
+
+namespace android {
+
+//////////////////////////////////////////////////////////////////////////////////
+// Bounded lock-free queue of frame references between exactly one producer
+// thread and one consumer thread. The queue owns the frames it holds.
+//////////////////////////////////////////////////////////////////////////////////
+class FFmpegFrameQueue {
+public:
+    // The capacity is rounded up to a power of two.
+    explicit FFmpegFrameQueue(size_t capacity);
+    ~FFmpegFrameQueue();
+
+    // Producer side. Moves the reference of src into the queue, returns false
+    // (and leaves src untouched) if the queue is full.
+    bool push(AVFrame* src);
+
+    // Consumer side. Moves the oldest reference into dst, returns false if
+    // the queue is empty.
+    bool pop(AVFrame* dst);
+
+    // Consumer side. Unreferences all the queued frames.
+    void clear();
+
+    bool empty() const;
+    bool full() const;
+
+private:
+    std::vector<AVFrame*> mFrames;
+    size_t mMask;
+    // Written by the producer only.
+    alignas(64) std::atomic<size_t> mTail;
+    // Written by the consumer only.
+    alignas(64) std::atomic<size_t> mHead;
+};
+
+}  // namespace android
+
+#endif  // FFMPEG_FRAMEQUEUE_H_
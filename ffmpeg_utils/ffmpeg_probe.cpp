@@ -0,0 +1,937 @@
+/*
+ * Copyright (C) 2024 KonstaKANG
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "FFMPEG"
+#include <utils/Log.h>
+
+#include <vector>
+
+#include "ffmpeg_probe.h"
+
+namespace android {
+
+// Above any level limit. Sizes and crops are checked against it before
+// being combined, garbage Exp-Golomb values would overflow otherwise.
+static constexpr uint32_t kMaxDimension = 16384;
+
+// MSB first bit reader. Reading past the end returns zeros and flags the
+// overrun, which callers check once the fields they need are read.
+class BitReader {
+public:
+    BitReader(const uint8_t *data, int size)
+        : mData(data), mBits((size_t)size * 8), mPos(0) {}
+
+    uint32_t u(int n) {
+        uint32_t value = 0;
+
+        for (int i = 0; i < n; i++) {
+            value <<= 1;
+            if (mPos < mBits) {
+                value |= (mData[mPos >> 3] >> (7 - (mPos & 7))) & 1;
+            }
+            mPos++;
+        }
+        return value;
+    }
+
+    void skip(size_t n) { mPos += n; }
+
+    // Exp-Golomb codes.
+    uint32_t ue() {
+        int zeros = 0;
+
+        while (u(1) == 0) {
+            if (++zeros > 31 || overrun()) {
+                mPos = mBits + 1;
+                return 0;
+            }
+        }
+        return ((1u << zeros) - 1) + u(zeros);
+    }
+
+    int32_t se() {
+        uint32_t value = ue();
+
+        return (value & 1) ? (int32_t)((value + 1) >> 1) : -(int32_t)(value >> 1);
+    }
+
+    // AV1 uvlc().
+    uint32_t uvlc() {
+        int zeros = 0;
+
+        while (u(1) == 0) {
+            if (overrun()) {
+                return 0;
+            }
+            zeros++;
+        }
+        if (zeros >= 32) {
+            return UINT32_MAX;
+        }
+        return u(zeros) + (1u << zeros) - 1;
+    }
+
+    bool overrun() const { return mPos > mBits; }
+
+private:
+    const uint8_t *mData;
+    size_t mBits;
+    size_t mPos;
+};
+
+// Strips the emulation prevention bytes of a NAL unit.
+static std::vector<uint8_t> nal_to_rbsp(const uint8_t *data, int size)
+{
+    std::vector<uint8_t> rbsp;
+    int zeros = 0;
+
+    rbsp.reserve(size);
+    for (int i = 0; i < size; i++) {
+        if (zeros >= 2 && data[i] == 3) {
+            zeros = 0;
+            continue;
+        }
+        zeros = (data[i] == 0) ? zeros + 1 : 0;
+        rbsp.push_back(data[i]);
+    }
+    return rbsp;
+}
+
+// Calls parse() on each NAL unit of Annex B data or of an avcC / hvcC record
+// until it returns true.
+template <typename Parser>
+static bool for_each_nal(enum AVCodecID codec_id, const uint8_t *data, int size, Parser parse)
+{
+    if (size > 6 && data[0] == 1) {
+        // avcC / hvcC
+        const uint8_t *p = data;
+        const uint8_t *end = data + size;
+        int arrays;
+
+        if (codec_id == AV_CODEC_ID_H264) {
+            // Only the SPS array is of interest.
+            p += 5;
+            arrays = 1;
+        } else {
+            if (size < 23) {
+                return false;
+            }
+            p += 22;
+            arrays = *p++;
+        }
+
+        for (int i = 0; i < arrays && p < end; i++) {
+            int count;
+
+            if (codec_id == AV_CODEC_ID_H264) {
+                count = *p++ & 0x1f;
+            } else {
+                if (end - p < 3) {
+                    return false;
+                }
+                count = (p[1] << 8) | p[2];
+                p += 3;
+            }
+            for (int j = 0; j < count; j++) {
+                if (end - p < 2) {
+                    return false;
+                }
+
+                int len = (p[0] << 8) | p[1];
+
+                p += 2;
+                if (len > end - p) {
+                    return false;
+                }
+                if (parse(p, len)) {
+                    return true;
+                }
+                p += len;
+            }
+        }
+        return false;
+    }
+
+    // Annex B
+    const uint8_t *nal = NULL;
+
+    for (int i = 0; i + 2 < size; i++) {
+        if (data[i] == 0 && data[i + 1] == 0 && data[i + 2] == 1) {
+            if (nal) {
+                int len = (int)(data + i - nal);
+
+                // Trailing zero of a 4-byte start code.
+                while (len > 0 && nal[len - 1] == 0) {
+                    len--;
+                }
+                if (parse(nal, len)) {
+                    return true;
+                }
+            }
+            nal = data + i + 3;
+            i += 2;
+        }
+    }
+    return nal && parse(nal, (int)(data + size - nal));
+}
+
+static void h264_skip_scaling_list(BitReader &br, int size)
+{
+    int last = 8;
+    int next = 8;
+
+    for (int i = 0; i < size; i++) {
+        if (next != 0) {
+            next = (last + br.se() + 256) % 256;
+        }
+        last = (next == 0) ? last : next;
+    }
+}
+
+static void h264_skip_hrd(BitReader &br)
+{
+    int count = br.ue() + 1;
+
+    br.skip(8);
+    for (int i = 0; i < count && !br.overrun(); i++) {
+        br.ue();
+        br.ue();
+        br.skip(1);
+    }
+    br.skip(20);
+}
+
+static bool h264_parse_sps(const uint8_t *nal, int size, FFmpegStreamInfo *info)
+{
+    if (size < 4 || (nal[0] & 0x1f) != 7) {
+        return false;
+    }
+
+    std::vector<uint8_t> rbsp = nal_to_rbsp(nal + 1, size - 1);
+    BitReader br(rbsp.data(), rbsp.size());
+    int profile = br.u(8);
+    int chroma_format = 1;
+    int bit_depth = 8;
+    bool separate_planes = false;
+
+    br.skip(16); // constraint flags, level_idc
+    br.ue();     // seq_parameter_set_id
+
+    switch (profile) {
+    case 100: case 110: case 122: case 244: case 44: case 83:
+    case 86: case 118: case 128: case 138: case 139: case 134: case 135:
+        chroma_format = br.ue();
+        if (chroma_format == 3) {
+            separate_planes = br.u(1);
+        }
+        bit_depth = br.ue() + 8;
+        br.ue();     // bit_depth_chroma_minus8
+        br.skip(1);  // qpprime_y_zero_transform_bypass_flag
+        if (br.u(1)) {
+            for (int i = 0; i < (chroma_format != 3 ? 8 : 12); i++) {
+                if (br.u(1)) {
+                    h264_skip_scaling_list(br, i < 6 ? 16 : 64);
+                }
+            }
+        }
+        break;
+    default:
+        break;
+    }
+
+    br.ue(); // log2_max_frame_num_minus4
+    int poc_type = br.ue();
+
+    if (poc_type == 0) {
+        br.ue();
+    } else if (poc_type == 1) {
+        br.skip(1);
+        br.se();
+        br.se();
+
+        int cycle = br.ue();
+
+        for (int i = 0; i < cycle && !br.overrun(); i++) {
+            br.se();
+        }
+    }
+
+    br.ue();     // max_num_ref_frames
+    br.skip(1);  // gaps_in_frame_num_value_allowed_flag
+
+    uint32_t width_mbs = br.ue() + 1;
+    uint32_t map_height_mbs = br.ue() + 1;
+    int frame_mbs_only = br.u(1);
+
+    if (width_mbs > kMaxDimension / 16 || map_height_mbs > kMaxDimension / 16) {
+        return false;
+    }
+
+    int width = width_mbs * 16;
+    int height = map_height_mbs * 16 * (2 - frame_mbs_only);
+
+    if (!frame_mbs_only) {
+        br.skip(1);
+    }
+    br.skip(1); // direct_8x8_inference_flag
+
+    if (br.u(1)) {
+        int crop_x = 1;
+        int crop_y = 2 - frame_mbs_only;
+
+        if (chroma_format != 0 && !separate_planes) {
+            crop_x = (chroma_format == 3) ? 1 : 2;
+            crop_y *= (chroma_format == 1) ? 2 : 1;
+        }
+
+        uint32_t left = br.ue();
+        uint32_t right = br.ue();
+        uint32_t top = br.ue();
+        uint32_t bottom = br.ue();
+
+        if (left > kMaxDimension || right > kMaxDimension ||
+                top > kMaxDimension || bottom > kMaxDimension) {
+            return false;
+        }
+        width -= (int)(left + right) * crop_x;
+        height -= (int)(top + bottom) * crop_y;
+    }
+
+    if (br.overrun()) {
+        return false;
+    }
+
+    // Baseline has no B-frames, other profiles only tell with VUI.
+    int reorder_depth = (profile == 66) ? 0 : -1;
+
+    if (br.u(1)) {
+        if (br.u(1) && br.u(8) == 255) {
+            br.skip(32); // sar_width, sar_height
+        }
+        if (br.u(1)) {
+            br.skip(1);
+        }
+        if (br.u(1)) {
+            br.skip(4);
+            if (br.u(1)) {
+                br.skip(24);
+            }
+        }
+        if (br.u(1)) {
+            br.ue();
+            br.ue();
+        }
+        if (br.u(1)) {
+            br.skip(65);
+        }
+
+        bool nal_hrd = br.u(1);
+
+        if (nal_hrd) {
+            h264_skip_hrd(br);
+        }
+
+        bool vcl_hrd = br.u(1);
+
+        if (vcl_hrd) {
+            h264_skip_hrd(br);
+        }
+        if (nal_hrd || vcl_hrd) {
+            br.skip(1);
+        }
+        br.skip(1); // pic_struct_present_flag
+        if (br.u(1)) {
+            br.skip(1);
+            br.ue();
+            br.ue();
+            br.ue();
+            br.ue();
+
+            int max_num_reorder_frames = br.ue();
+
+            br.ue(); // max_dec_frame_buffering
+            if (!br.overrun()) {
+                reorder_depth = max_num_reorder_frames;
+            }
+        }
+    }
+
+    if (width <= 0 || height <= 0 || bit_depth > 14) {
+        return false;
+    }
+
+    info->width = width;
+    info->height = height;
+    info->bit_depth = bit_depth;
+    info->chroma_format = chroma_format;
+    info->reorder_depth = reorder_depth;
+    return true;
+}
+
+static void hevc_skip_profile_tier_level(BitReader &br, int max_sub_layers_minus1)
+{
+    bool profile_present[8];
+    bool level_present[8];
+
+    br.skip(88); // general profile
+    br.skip(8);  // general_level_idc
+    for (int i = 0; i < max_sub_layers_minus1; i++) {
+        profile_present[i] = br.u(1);
+        level_present[i] = br.u(1);
+    }
+    if (max_sub_layers_minus1 > 0) {
+        br.skip(2 * (8 - max_sub_layers_minus1));
+    }
+    for (int i = 0; i < max_sub_layers_minus1; i++) {
+        if (profile_present[i]) {
+            br.skip(88);
+        }
+        if (level_present[i]) {
+            br.skip(8);
+        }
+    }
+}
+
+static bool hevc_parse_sps(const uint8_t *nal, int size, FFmpegStreamInfo *info)
+{
+    if (size < 4 || ((nal[0] >> 1) & 0x3f) != 33) {
+        return false;
+    }
+
+    std::vector<uint8_t> rbsp = nal_to_rbsp(nal + 2, size - 2);
+    BitReader br(rbsp.data(), rbsp.size());
+
+    br.skip(4); // sps_video_parameter_set_id
+
+    int max_sub_layers_minus1 = br.u(3);
+
+    br.skip(1); // sps_temporal_id_nesting_flag
+    if (max_sub_layers_minus1 > 6) {
+        return false;
+    }
+    hevc_skip_profile_tier_level(br, max_sub_layers_minus1);
+
+    br.ue(); // sps_seq_parameter_set_id
+
+    int chroma_format = br.ue();
+    bool separate_planes = false;
+
+    if (chroma_format == 3) {
+        separate_planes = br.u(1);
+    }
+
+    uint32_t coded_width = br.ue();
+    uint32_t coded_height = br.ue();
+
+    if (coded_width > kMaxDimension || coded_height > kMaxDimension) {
+        return false;
+    }
+
+    int width = coded_width;
+    int height = coded_height;
+
+    if (br.u(1)) {
+        int sub_width = (chroma_format == 1 || chroma_format == 2) && !separate_planes ? 2 : 1;
+        int sub_height = (chroma_format == 1) && !separate_planes ? 2 : 1;
+        uint32_t left = br.ue();
+        uint32_t right = br.ue();
+        uint32_t top = br.ue();
+        uint32_t bottom = br.ue();
+
+        if (left > kMaxDimension || right > kMaxDimension ||
+                top > kMaxDimension || bottom > kMaxDimension) {
+            return false;
+        }
+        width -= (int)(left + right) * sub_width;
+        height -= (int)(top + bottom) * sub_height;
+    }
+
+    int bit_depth = br.ue() + 8;
+
+    br.ue(); // bit_depth_chroma_minus8
+    br.ue(); // log2_max_pic_order_cnt_lsb_minus4
+
+    // The highest sub-layer is the one decoded.
+    int reorder_depth = 0;
+    bool ordering_info = br.u(1);
+
+    for (int i = ordering_info ? 0 : max_sub_layers_minus1; i <= max_sub_layers_minus1; i++) {
+        br.ue(); // sps_max_dec_pic_buffering_minus1
+        reorder_depth = br.ue();
+        br.ue(); // sps_max_latency_increase_plus1
+    }
+
+    if (br.overrun() || width <= 0 || height <= 0 || bit_depth > 16) {
+        return false;
+    }
+
+    info->width = width;
+    info->height = height;
+    info->bit_depth = bit_depth;
+    info->chroma_format = chroma_format;
+    info->reorder_depth = reorder_depth;
+    return true;
+}
+
+static bool hevc_parse_pps(const uint8_t *nal, int size, FFmpegStreamInfo *info)
+{
+    if (size < 3 || ((nal[0] >> 1) & 0x3f) != 34) {
+        return false;
+    }
+
+    std::vector<uint8_t> rbsp = nal_to_rbsp(nal + 2, size - 2);
+    BitReader br(rbsp.data(), rbsp.size());
+
+    br.ue(); // pps_pic_parameter_set_id
+    br.ue(); // pps_seq_parameter_set_id
+    br.skip(1); // dependent_slice_segments_enabled_flag
+    br.skip(1); // output_flag_present_flag
+    br.skip(3); // num_extra_slice_header_bits
+    br.skip(1); // sign_data_hiding_enabled_flag
+    br.skip(1); // cabac_init_present_flag
+    br.ue(); // num_ref_idx_l0_default_active_minus1
+    br.ue(); // num_ref_idx_l1_default_active_minus1
+    br.se(); // init_qp_minus26
+    br.skip(1); // constrained_intra_pred_flag
+    br.skip(1); // transform_skip_enabled_flag
+    if (br.u(1)) { // cu_qp_delta_enabled_flag
+        br.ue(); // diff_cu_qp_delta_depth
+    }
+    br.se(); // pps_cb_qp_offset
+    br.se(); // pps_cr_qp_offset
+    br.skip(1); // pps_slice_chroma_qp_offsets_present_flag
+    br.skip(1); // weighted_pred_flag
+    br.skip(1); // weighted_bipred_flag
+    br.skip(1); // transquant_bypass_enabled_flag
+
+    bool tiles = br.u(1);
+    bool wavefronts = br.u(1);
+
+    if (br.overrun()) {
+        return false;
+    }
+
+    info->parallel_slices = tiles || wavefronts;
+    return true;
+}
+
+static bool av1_parse_sequence_header(const uint8_t *data, int size, FFmpegStreamInfo *info)
+{
+    BitReader br(data, size);
+    int profile = br.u(3);
+
+    br.skip(1); // still_picture
+
+    bool reduced = br.u(1);
+
+    if (reduced) {
+        br.skip(5); // seq_level_idx[0]
+    } else {
+        bool decoder_model_info = false;
+        int buffer_delay_length = 0;
+
+        if (br.u(1)) {
+            // timing_info
+            br.skip(64);
+            if (br.u(1)) {
+                br.uvlc();
+            }
+            decoder_model_info = br.u(1);
+            if (decoder_model_info) {
+                buffer_delay_length = br.u(5) + 1;
+                br.skip(32 + 5 + 5);
+            }
+        }
+
+        bool initial_display_delay = br.u(1);
+        int operating_points = br.u(5) + 1;
+
+        for (int i = 0; i < operating_points && !br.overrun(); i++) {
+            br.skip(12); // operating_point_idc
+
+            if (br.u(5) > 7) {
+                br.skip(1); // seq_tier
+            }
+            if (decoder_model_info && br.u(1)) {
+                br.skip(2 * buffer_delay_length + 1);
+            }
+            if (initial_display_delay && br.u(1)) {
+                br.skip(4);
+            }
+        }
+    }
+
+    int width_bits = br.u(4) + 1;
+    int height_bits = br.u(4) + 1;
+    int width = br.u(width_bits) + 1;
+    int height = br.u(height_bits) + 1;
+
+    if (!reduced && br.u(1)) {
+        br.skip(4 + 3); // frame id lengths
+    }
+    br.skip(3); // use_128x128_superblock, enable_filter_intra, enable_intra_edge_filter
+    if (!reduced) {
+        br.skip(4); // interintra, masked, warped motion, dual filter
+
+        bool order_hint = br.u(1);
+
+        if (order_hint) {
+            br.skip(2); // jnt_comp, ref_frame_mvs
+        }
+
+        int force_screen_content_tools = 2;
+
+        if (!br.u(1)) {
+            force_screen_content_tools = br.u(1);
+        }
+        if (force_screen_content_tools > 0 && !br.u(1)) {
+            br.skip(1); // seq_force_integer_mv
+        }
+        if (order_hint) {
+            br.skip(3);
+        }
+    }
+    br.skip(3); // enable_superres, enable_cdef, enable_restoration
+
+    int bit_depth = 8;
+
+    if (br.u(1)) {
+        bit_depth = (profile == 2 && br.u(1)) ? 12 : 10;
+    }
+
+    // color_config()
+    bool mono_chrome = profile != 1 && br.u(1);
+    int color_primaries = 2;
+    int transfer_characteristics = 2;
+    int matrix_coefficients = 2;
+
+    if (br.u(1)) {
+        color_primaries = br.u(8);
+        transfer_characteristics = br.u(8);
+        matrix_coefficients = br.u(8);
+    }
+
+    int chroma_format;
+
+    if (mono_chrome) {
+        chroma_format = 0;
+    } else if (color_primaries == 1 && transfer_characteristics == 13 && matrix_coefficients == 0) {
+        // sRGB
+        chroma_format = 3;
+    } else {
+        br.skip(1); // color_range
+
+        if (profile == 0) {
+            chroma_format = 1;
+        } else if (profile == 1) {
+            chroma_format = 3;
+        } else if (bit_depth == 12) {
+            bool subsampling_x = br.u(1);
+            bool subsampling_y = subsampling_x && br.u(1);
+
+            chroma_format = !subsampling_x ? 3 : subsampling_y ? 1 : 2;
+        } else {
+            chroma_format = 2;
+        }
+    }
+
+    if (br.overrun()) {
+        return false;
+    }
+
+    // max_frame_width_minus_1 and max_frame_height_minus_1, frames may be
+    // smaller.
+    info->width = width;
+    info->height = height;
+    info->size_is_max = true;
+    info->bit_depth = bit_depth;
+    info->chroma_format = chroma_format;
+    // Hidden frames, but no reordering at the output.
+    info->reorder_depth = 0;
+    return true;
+}
+
+// Calls parse(type, obu, size) on each OBU until it returns true.
+template <typename Parser>
+static bool for_each_obu(const uint8_t *data, int size, Parser parse)
+{
+    const uint8_t *p = data;
+    const uint8_t *end = data + size;
+
+    // av1C record, followed by the configuration OBUs.
+    if (size >= 4 && data[0] == 0x81) {
+        p += 4;
+    }
+
+    while (end - p >= 2) {
+        int type = (p[0] >> 3) & 0xf;
+        bool extension = (p[0] >> 2) & 1;
+        bool has_size = (p[0] >> 1) & 1;
+        uint64_t obu_size = 0;
+
+        p += 1 + extension;
+        if (has_size) {
+            for (int i = 0; i < 8 && p < end; i++) {
+                obu_size |= (uint64_t)(*p & 0x7f) << (7 * i);
+                if (!(*p++ & 0x80)) {
+                    break;
+                }
+            }
+        } else {
+            obu_size = end - p;
+        }
+        if (obu_size > (uint64_t)(end - p)) {
+            return false;
+        }
+        if (parse(type, p, (int)obu_size)) {
+            return true;
+        }
+        p += obu_size;
+    }
+    return false;
+}
+
+static bool av1_parse_obus(const uint8_t *data, int size, FFmpegStreamInfo *info)
+{
+    bool found = false;
+
+    for_each_obu(data, size, [&](int type, const uint8_t *obu, int len) {
+        if (type == 1) {
+            found = av1_parse_sequence_header(obu, len, info);
+            return true;
+        }
+        return false;
+    });
+    return found;
+}
+
+static bool vp9_parse_key_frame(const uint8_t *data, int size, FFmpegStreamInfo *info)
+{
+    BitReader br(data, size);
+
+    if (br.u(2) != 2) {
+        return false;
+    }
+
+    int profile = br.u(1);
+
+    profile |= br.u(1) << 1;
+    if (profile == 3) {
+        br.skip(1);
+    }
+    if (br.u(1)) {
+        // show_existing_frame
+        return false;
+    }
+    if (br.u(1) != 0) {
+        // Not a key frame, the size may be inherited.
+        return false;
+    }
+    br.skip(2); // show_frame, error_resilient_mode
+    if (br.u(24) != 0x498342) {
+        return false;
+    }
+
+    int bit_depth = 8;
+    int chroma_format = 1;
+
+    if (profile >= 2) {
+        bit_depth = br.u(1) ? 12 : 10;
+    }
+    if (br.u(3) != 7) {
+        br.skip(1); // color_range
+        if (profile == 1 || profile == 3) {
+            int subsampling_x = br.u(1);
+            int subsampling_y = br.u(1);
+
+            chroma_format = subsampling_x ? (subsampling_y ? 1 : 2) : 3;
+            br.skip(1);
+        }
+    } else {
+        // RGB
+        chroma_format = 3;
+        if (profile == 1 || profile == 3) {
+            br.skip(1);
+        }
+    }
+
+    int width = br.u(16) + 1;
+    int height = br.u(16) + 1;
+
+    if (br.overrun()) {
+        return false;
+    }
+
+    info->width = width;
+    info->height = height;
+    info->bit_depth = bit_depth;
+    info->chroma_format = chroma_format;
+    info->reorder_depth = 0;
+    return true;
+}
+
+bool ffmpeg_can_probe_stream_info(enum AVCodecID codec_id)
+{
+    switch (codec_id) {
+    case AV_CODEC_ID_H264:
+    case AV_CODEC_ID_HEVC:
+    case AV_CODEC_ID_AV1:
+    case AV_CODEC_ID_VP9:
+        return true;
+    default:
+        return false;
+    }
+}
+
+bool ffmpeg_probe_stream_info(enum AVCodecID codec_id, const uint8_t *data, int size,
+        FFmpegStreamInfo *info)
+{
+    if (!data || size <= 0) {
+        return false;
+    }
+
+    info->size_is_max = false;
+    info->parallel_slices = false;
+
+    switch (codec_id) {
+    case AV_CODEC_ID_H264:
+        return for_each_nal(codec_id, data, size, [info](const uint8_t *nal, int len) {
+            return h264_parse_sps(nal, len, info);
+        });
+    case AV_CODEC_ID_HEVC:
+        if (!for_each_nal(codec_id, data, size, [info](const uint8_t *nal, int len) {
+                return hevc_parse_sps(nal, len, info);
+            })) {
+            return false;
+        }
+        // Optional, the PPS may come later.
+        for_each_nal(codec_id, data, size, [info](const uint8_t *nal, int len) {
+            return hevc_parse_pps(nal, len, info);
+        });
+        return true;
+    case AV_CODEC_ID_AV1:
+        return av1_parse_obus(data, size, info);
+    case AV_CODEC_ID_VP9:
+        return vp9_parse_key_frame(data, size, info);
+    default:
+        return false;
+    }
+}
+
+bool ffmpeg_is_key_frame(enum AVCodecID codec_id, const uint8_t *data, int size)
+{
+    if (!data || size <= 0) {
+        return false;
+    }
+
+    switch (codec_id) {
+    case AV_CODEC_ID_H264:
+        return for_each_nal(codec_id, data, size, [](const uint8_t *nal, int len) {
+            return len > 0 && (nal[0] & 0x1f) == 5;
+        });
+    case AV_CODEC_ID_HEVC:
+        // IDR_W_RADL may be followed by leading pictures output before it.
+        return for_each_nal(codec_id, data, size, [](const uint8_t *nal, int len) {
+            return len > 0 && ((nal[0] >> 1) & 0x3f) == 20;
+        });
+    case AV_CODEC_ID_VP8:
+        // Frame tag: frame_type(1) version(3) show_frame(1) ...
+        return !(data[0] & 1) && ((data[0] >> 4) & 1);
+    case AV_CODEC_ID_VP9: {
+        BitReader br(data, size);
+
+        if (br.u(2) != 2) {
+            return false;
+        }
+
+        int profile = br.u(1);
+
+        profile |= br.u(1) << 1;
+        if (profile == 3) {
+            br.skip(1);
+        }
+        // show_existing_frame, frame_type, show_frame
+        bool key = !br.u(1) && !br.u(1) && br.u(1);
+
+        return key && !br.overrun();
+    }
+    case AV_CODEC_ID_AV1: {
+        bool reduced = false;
+        bool key = false;
+
+        for_each_obu(data, size, [&](int type, const uint8_t *obu, int len) {
+            BitReader br(obu, len);
+
+            if (type == 1) {
+                // seq_profile, still_picture, reduced_still_picture_header
+                br.skip(4);
+                reduced = br.u(1);
+                return false;
+            }
+            if (type != 3 && type != 6) {
+                return false;
+            }
+            // First frame header: show_existing_frame, frame_type, show_frame
+            key = reduced || (!br.u(1) && br.u(2) == 0 && br.u(1) && !br.overrun());
+            return true;
+        });
+        return key;
+    }
+    default:
+        return false;
+    }
+}
+
+bool ffmpeg_codec_config_complete(enum AVCodecID codec_id, const uint8_t *data, int size)
+{
+    if (!data || size <= 0) {
+        return false;
+    }
+
+    bool vps = false;
+    bool sps = false;
+    bool pps = false;
+
+    switch (codec_id) {
+    case AV_CODEC_ID_H264:
+        if (size > 6 && data[0] == 1) {
+            // avcC, always with the SPS and PPS arrays.
+            return true;
+        }
+        return for_each_nal(codec_id, data, size, [&](const uint8_t *nal, int len) {
+            if (len > 0) {
+                sps |= (nal[0] & 0x1f) == 7;
+                pps |= (nal[0] & 0x1f) == 8;
+            }
+            return sps && pps;
+        });
+    case AV_CODEC_ID_HEVC:
+        return for_each_nal(codec_id, data, size, [&](const uint8_t *nal, int len) {
+            if (len > 0) {
+                int type = (nal[0] >> 1) & 0x3f;
+
+                vps |= type == 32;
+                sps |= type == 33;
+                pps |= type == 34;
+            }
+            return vps && sps && pps;
+        });
+    default:
+        return true;
+    }
+}
+
+}  // namespace android
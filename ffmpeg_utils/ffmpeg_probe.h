@@ -0,0 +1,67 @@
+/*
+ * Copyright (C) 2024 KonstaKANG
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef FFMPEG_PROBE_H_
+
+#define FFMPEG_PROBE_H_
+
+#include "ffmpeg_utils.h"
+
+namespace android {
+
+//////////////////////////////////////////////////////////////////////////////////
+// Lightweight parsing of the sequence level headers, to learn the stream
+// properties before the decoder is opened:
+// - H.264 / HEVC: SPS (and HEVC PPS), from Annex B data or avcC / hvcC records
+// - AV1: sequence header OBU, from raw OBUs or an av1C record
+// - VP9: uncompressed header of a key frame
+//////////////////////////////////////////////////////////////////////////////////
+struct FFmpegStreamInfo {
+    // Displayed size, cropping applied. AV1 sequence headers only give the
+    // largest frame size, see size_is_max.
+    int width;
+    int height;
+    // The size is an upper bound of the frame size, not the picture size.
+    bool size_is_max;
+    int bit_depth;
+    // 0: monochrome, 1: 4:2:0, 2: 4:2:2, 3: 4:4:4
+    int chroma_format;
+    // Pictures held back for reordering, -1 if not signalled.
+    int reorder_depth;
+    // Pictures are coded for parallel decoding (HEVC wavefronts or tiles).
+    bool parallel_slices;
+};
+
+// Returns true if the stream properties of the codec can be probed.
+bool ffmpeg_can_probe_stream_info(enum AVCodecID codec_id);
+
+// Returns true if the headers were found and info filled in.
+bool ffmpeg_probe_stream_info(enum AVCodecID codec_id, const uint8_t *data, int size,
+        FFmpegStreamInfo *info);
+
+// Returns true if decoding can start with the packet, and no picture
+// decoded after it is output before it: H.264 IDR and HEVC IDR_N_LP
+// pictures, in Annex B, and shown VP8, VP9 and AV1 key frames.
+bool ffmpeg_is_key_frame(enum AVCodecID codec_id, const uint8_t *data, int size);
+
+// Returns true if the codec config holds what the decoder needs to be opened:
+// the SPS and PPS for H.264, the VPS, SPS and PPS for HEVC, anything for the
+// other codecs.
+bool ffmpeg_codec_config_complete(enum AVCodecID codec_id, const uint8_t *data, int size);
+
+}  // namespace android
+
+#endif  // FFMPEG_PROBE_H_
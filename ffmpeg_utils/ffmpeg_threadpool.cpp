@@ -0,0 +1,245 @@
+/*
+ * Copyright (C) 2024 KonstaKANG
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "FFMPEG"
+#include <utils/Log.h>
+
+#include <algorithm>
+
+#include "ffmpeg_threadpool.h"
+#include "ffmpeg_utils.h"
+
+namespace android {
+
+FFmpegThreadPool& FFmpegThreadPool::instance() {
+    static FFmpegThreadPool* sInstance = new FFmpegThreadPool();
+    return *sInstance;
+}
+
+// Virtual time of an index run with weight 1.
+static constexpr uint64_t kWeightScale = 1 << 16;
+static constexpr int kMaxSlots = 64;
+
+FFmpegThreadPool::FFmpegThreadPool()
+    : mDefaultSession(1),
+      mConcurrency(0),
+      mIdleWorkers(0),
+      mStarted(false),
+      mStopping(false) {
+}
+
+FFmpegThreadPool::~FFmpegThreadPool() {
+    {
+        std::lock_guard<std::mutex> lock(mLock);
+        mStopping = true;
+    }
+    mJobCond.notify_all();
+    for (auto& thread : mThreads) {
+        thread.join();
+    }
+}
+
+void FFmpegThreadPool::start() {
+    // The caller always participates, so one thread less is needed.
+    int nthreads = ffmpeg_cpu_count() - 1;
+
+    for (int i = 0; i < nthreads; i++) {
+        mThreads.emplace_back(&FFmpegThreadPool::workerLoop, this);
+    }
+    mStarted = true;
+    mConcurrency.store(nthreads + 1, std::memory_order_release);
+
+    ALOGD("FFmpegThreadPool: started %d worker threads", nthreads);
+}
+
+int FFmpegThreadPool::getConcurrency() {
+    int concurrency = mConcurrency.load(std::memory_order_acquire);
+
+    if (concurrency) {
+        return concurrency;
+    }
+
+    std::lock_guard<std::mutex> lock(mLock);
+
+    if (! mStarted) {
+        start();
+    }
+    return mConcurrency.load(std::memory_order_relaxed);
+}
+
+FFmpegThreadPool::Session* FFmpegThreadPool::createSession(int weight) {
+    Session* session = new Session(std::max(weight, 1));
+    std::lock_guard<std::mutex> lock(mLock);
+    uint64_t virtualTime = UINT64_MAX;
+
+    // Start level with the busy sessions, neither behind nor ahead.
+    for (Job* job : mJobs) {
+        virtualTime = std::min(virtualTime, job->session->mVirtualTime.load());
+    }
+    if (virtualTime != UINT64_MAX) {
+        session->mVirtualTime = virtualTime;
+    }
+    return session;
+}
+
+void FFmpegThreadPool::setSessionWeight(Session* session, int weight) {
+    session->mWeight = std::max(weight, 1);
+}
+
+void FFmpegThreadPool::destroySession(Session* session) {
+    delete session;
+}
+
+bool FFmpegThreadPool::runIndex(Job* job) {
+    uint64_t slots = job->freeSlots.load();
+
+    // Claim the lowest free slot.
+    while (slots && ! job->freeSlots.compare_exchange_weak(slots, slots & (slots - 1))) {
+    }
+    if (! slots) {
+        return false;
+    }
+
+    uint64_t slot = slots & -slots;
+    int index = job->next.fetch_add(1);
+
+    if (index < job->count) {
+        (*job->fn)(index, __builtin_ctzll(slot));
+        job->session->mVirtualTime.fetch_add(kWeightScale / job->session->mWeight.load());
+        job->done.fetch_add(1);
+    }
+    job->freeSlots.fetch_or(slot);
+    return index < job->count;
+}
+
+FFmpegThreadPool::Job* FFmpegThreadPool::pickJob() {
+    Job* best = NULL;
+
+    for (auto it = mJobs.begin(); it != mJobs.end();) {
+        Job* job = *it;
+
+        if (job->next.load() >= job->count) {
+            // All indices claimed, the owner is waiting for completion.
+            job->session->mJobs--;
+            it = mJobs.erase(it);
+            continue;
+        }
+        if (job->freeSlots.load() &&
+                (! best || job->session->mVirtualTime.load() < best->session->mVirtualTime.load())) {
+            best = job;
+        }
+        ++it;
+    }
+    return best;
+}
+
+void FFmpegThreadPool::workerLoop() {
+    std::unique_lock<std::mutex> lock(mLock);
+
+    while (! mStopping) {
+        Job* job = pickJob();
+
+        if (! job) {
+            mIdleWorkers++;
+            mJobCond.wait(lock);
+            mIdleWorkers--;
+            continue;
+        }
+
+        // One index at a time, so that the choice of session is made again
+        // as soon as a worker is free.
+        job->active++;
+        lock.unlock();
+        runIndex(job);
+        lock.lock();
+        job->active--;
+        mDoneCond.notify_all();
+        if (mIdleWorkers && job->next.load() < job->count) {
+            // A slot was released, a worker may have been waiting for it.
+            mJobCond.notify_one();
+        }
+    }
+}
+
+void FFmpegThreadPool::parallelFor(int count, const std::function<void(int)>& fn) {
+    parallelFor(&mDefaultSession, count, kMaxSlots, [&fn](int index, int /* slot */) {
+        fn(index);
+    });
+}
+
+void FFmpegThreadPool::parallelFor(Session* session, int count, int maxSlots,
+                                   const std::function<void(int, int)>& fn) {
+    maxSlots = std::min(maxSlots, kMaxSlots);
+    if (count <= 1 || maxSlots <= 1 || getConcurrency() <= 1) {
+        for (int i = 0; i < count; i++) {
+            fn(i, 0);
+        }
+        return;
+    }
+
+    Job job;
+
+    job.session = session ? session : &mDefaultSession;
+    job.fn = &fn;
+    job.count = count;
+    job.next = 0;
+    job.done = 0;
+    job.freeSlots = maxSlots == kMaxSlots ? UINT64_MAX : (1ull << maxSlots) - 1;
+    job.active = 0;
+
+    {
+        std::lock_guard<std::mutex> lock(mLock);
+
+        if (job.session->mJobs == 0 && ! mJobs.empty()) {
+            // No credit for the time spent idle: catch up with the least
+            // served busy session.
+            uint64_t virtualTime = UINT64_MAX;
+
+            for (Job* other : mJobs) {
+                virtualTime = std::min(virtualTime, other->session->mVirtualTime.load());
+            }
+            if (job.session->mVirtualTime.load() < virtualTime) {
+                job.session->mVirtualTime = virtualTime;
+            }
+        }
+        job.session->mJobs++;
+        mJobs.push_back(&job);
+    }
+    mJobCond.notify_all();
+
+    std::unique_lock<std::mutex> lock(mLock);
+
+    while (job.next.load() < job.count) {
+        lock.unlock();
+        while (runIndex(&job)) {
+        }
+        lock.lock();
+        // All slots are taken by workers, join again when one is free.
+        mDoneCond.wait(lock, [&job] { return job.next.load() >= job.count || job.freeSlots.load(); });
+    }
+
+    // Workers may still be running the last claimed indices.
+    mDoneCond.wait(lock, [&job] { return job.done.load() == job.count && job.active == 0; });
+
+    auto it = std::find(mJobs.begin(), mJobs.end(), &job);
+
+    if (it != mJobs.end()) {
+        job.session->mJobs--;
+        mJobs.erase(it);
+    }
+}
+
+}  // namespace android
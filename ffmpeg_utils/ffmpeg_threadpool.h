@@ -0,0 +1,111 @@
+/*
+ * Copyright (C) 2024 KonstaKANG
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef FFMPEG_THREADPOOL_H_
+
+#define FFMPEG_THREADPOOL_H_
+
+#include <stdint.h>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace android {
+
+//////////////////////////////////////////////////////////////////////////////////
+// Process-wide worker pool, shared by all component instances.
+//
+// Jobs belong to sessions. Idle workers pick the next index to run from the
+// job of the session that got the least CPU time relative to its weight,
+// so that concurrent decoders share the cores instead of each creating as
+// many threads as there are cores.
+//////////////////////////////////////////////////////////////////////////////////
+class FFmpegThreadPool {
+public:
+    class Session {
+    public:
+        explicit Session(int weight) : mWeight(weight), mVirtualTime(0), mJobs(0) {}
+
+    private:
+        friend class FFmpegThreadPool;
+
+        // Relative share of the workers, at least 1.
+        std::atomic<int> mWeight;
+        // Indices run, scaled by the inverse of the weight.
+        std::atomic<uint64_t> mVirtualTime;
+        // Queued jobs, protected by the pool lock.
+        int mJobs;
+    };
+
+    static FFmpegThreadPool& instance();
+
+    // Number of threads that can run jobs concurrently, including the caller.
+    int getConcurrency();
+
+    Session* createSession(int weight);
+    void setSessionWeight(Session* session, int weight);
+    // The session must not have jobs running.
+    void destroySession(Session* session);
+
+    // Runs fn(0) ... fn(count - 1) in parallel and returns when all of them
+    // are done. The calling thread participates, and jobs are started in
+    // index order.
+    void parallelFor(int count, const std::function<void(int)>& fn);
+    // Same for a session, with at most maxSlots threads at once. Each one
+    // runs fn(index, slot) with its own slot in [0, maxSlots), as libavcodec
+    // expects from execute2() thread numbers. maxSlots is at most 64.
+    void parallelFor(Session* session, int count, int maxSlots,
+                     const std::function<void(int, int)>& fn);
+
+private:
+    struct Job {
+        Session* session;
+        const std::function<void(int, int)>* fn;
+        int count;
+        std::atomic<int> next;
+        std::atomic<int> done;
+        // Bit set for each slot not in use.
+        std::atomic<uint64_t> freeSlots;
+        int active;
+    };
+
+    FFmpegThreadPool();
+    ~FFmpegThreadPool();
+    void start();
+    void workerLoop();
+    Job* pickJob();
+    static bool runIndex(Job* job);
+
+    std::mutex mLock;
+    std::condition_variable mJobCond;
+    std::condition_variable mDoneCond;
+    std::deque<Job*> mJobs;
+    std::vector<std::thread> mThreads;
+    Session mDefaultSession;
+    // Set once the workers are started, read without the lock.
+    std::atomic<int> mConcurrency;
+    int mIdleWorkers;
+    bool mStarted;
+    bool mStopping;
+};
+
+}  // namespace android
+
+#endif  // FFMPEG_THREADPOOL_H_
@@ -27,6 +27,8 @@ extern "C" {
 #include <inttypes.h>
 #include <math.h>
 #include <limits.h> /* INT_MAX */
+#include <sched.h>
+#include <stdio.h>
 #include <time.h>
 
 #undef strncpy
@@ -233,5 +235,167 @@ bool setup_vorbis_extradata(uint8_t **extradata, int *extradata_size,
     return true;
 }
 
+// Uncompressed header: frame_marker(2) profile_low_bit(1) profile_high_bit(1)
+// [reserved_zero(1) for profile 3] show_existing_frame(1) frame_type(1)
+// show_frame(1), all within the first byte. Anything unexpected counts as
+// shown.
+static bool vp9_shows_frame(const uint8_t *data, int size)
+{
+    int profile;
+    int pos;
+
+    if (size < 1 || (data[0] >> 6) != 2) {
+        return true;
+    }
+
+    profile = ((data[0] >> 5) & 1) | (((data[0] >> 4) & 1) << 1);
+    pos = (profile == 3) ? 2 : 3;
+    if ((data[0] >> pos) & 1) {
+        // show_existing_frame
+        return true;
+    }
+    return (data[0] >> (pos - 2)) & 1;
+}
+
+bool ffmpeg_is_hidden_frame(enum AVCodecID codec_id, const uint8_t *data, int size)
+{
+    if (!data || size < 1) {
+        return false;
+    }
+
+    switch (codec_id) {
+    case AV_CODEC_ID_VP8:
+        // Frame tag: frame_type(1) version(3) show_frame(1) ...
+        return !((data[0] >> 4) & 1);
+    case AV_CODEC_ID_VP9: {
+        uint8_t marker = data[size - 1];
+
+        // Superframe index: the packet is hidden only if all its frames are.
+        if ((marker & 0xe0) == 0xc0) {
+            int frames = (marker & 0x7) + 1;
+            int mag = ((marker >> 3) & 0x3) + 1;
+            int index_size = 2 + mag * frames;
+
+            if (size >= index_size && data[size - index_size] == marker) {
+                const uint8_t *p = data + size - index_size + 1;
+                int offset = 0;
+
+                for (int i = 0; i < frames; i++) {
+                    int frame_size = 0;
+
+                    for (int j = 0; j < mag; j++) {
+                        frame_size |= *p++ << (j * 8);
+                    }
+                    if (frame_size <= 0 || frame_size > size - index_size - offset) {
+                        return false;
+                    }
+                    if (vp9_shows_frame(data + offset, frame_size)) {
+                        return false;
+                    }
+                    offset += frame_size;
+                }
+                return true;
+            }
+        }
+        return !vp9_shows_frame(data, size);
+    }
+    default:
+        return false;
+    }
+}
+
+// CPUs worth of quota, 0 if unlimited or unknown. cgroup v2 has
+// "<quota> <period>" in cpu.max, v1 cpu.cfs_quota_us and cpu.cfs_period_us.
+static int cgroup_cpu_quota()
+{
+    FILE *f = fopen("/proc/self/cgroup", "r");
+    char line[512];
+    char path[PATH_MAX];
+    long long quota = -1, period = 0;
+
+    if (!f) {
+        return 0;
+    }
+
+    while (quota < 0 && fgets(line, sizeof(line), f)) {
+        char *controllers = strchr(line, ':');
+        char *group = controllers ? strchr(controllers + 1, ':') : NULL;
+
+        if (!group) {
+            continue;
+        }
+        *group++ = 0;
+        group[strcspn(group, "\n")] = 0;
+        controllers++;
+
+        if (*controllers == 0) {
+            snprintf(path, sizeof(path), "/sys/fs/cgroup%s/cpu.max", group);
+
+            FILE *max = fopen(path, "r");
+
+            if (max) {
+                if (fscanf(max, "%lld %lld", &quota, &period) != 2) {
+                    // "max": no quota
+                    quota = -1;
+                }
+                fclose(max);
+            }
+        } else if (!strcmp(controllers, "cpu") || strstr(controllers, "cpu,") == controllers) {
+            static const char *roots[] = { "/dev/cpuctl", "/sys/fs/cgroup/cpu" };
+
+            for (size_t i = 0; i < sizeof(roots) / sizeof(roots[0]) && quota < 0; i++) {
+                snprintf(path, sizeof(path), "%s%s/cpu.cfs_quota_us", roots[i], group);
+
+                FILE *q = fopen(path, "r");
+
+                if (!q) {
+                    continue;
+                }
+                if (fscanf(q, "%lld", &quota) != 1) {
+                    quota = -1;
+                }
+                fclose(q);
+
+                snprintf(path, sizeof(path), "%s%s/cpu.cfs_period_us", roots[i], group);
+
+                FILE *p = fopen(path, "r");
+
+                if (!p || fscanf(p, "%lld", &period) != 1) {
+                    quota = -1;
+                }
+                if (p) {
+                    fclose(p);
+                }
+            }
+        }
+    }
+    fclose(f);
+
+    if (quota <= 0 || period <= 0) {
+        return 0;
+    }
+    return (int)((quota + period - 1) / period);
+}
+
+int ffmpeg_cpu_count()
+{
+    cpu_set_t set;
+    int count = 0;
+
+    if (sched_getaffinity(0, sizeof(set), &set) == 0) {
+        count = CPU_COUNT(&set);
+    }
+    if (count <= 0) {
+        count = sysconf(_SC_NPROCESSORS_ONLN);
+    }
+
+    int quota = cgroup_cpu_quota();
+
+    if (quota > 0 && quota < count) {
+        count = quota;
+    }
+    return count > 0 ? count : 1;
+}
+
 }  // namespace android
 
@@ -58,6 +58,16 @@ void deInitFFmpeg();
 bool setup_vorbis_extradata(uint8_t **extradata, int *extradata_size,
         const uint8_t *header_start[3], const int header_len[3]);
 
+// Returns true if every frame in the packet is decoded but never shown
+// (VP8 alt-ref frames, VP9 frames with show_frame = 0), meaning the packet
+// will not produce any picture.
+bool ffmpeg_is_hidden_frame(enum AVCodecID codec_id, const uint8_t *data, int size);
+
+// Number of CPUs the process can actually use: the CPUs of its affinity
+// mask (cpuset), bounded by the CPU quota of its cgroup. At least 1.
+// Reads procfs and cgroup files, callers should keep the result.
+int ffmpeg_cpu_count();
+
 }  // namespace android
 
 #endif  // FFMPEG_UTILS_H_
@@ -0,0 +1,53 @@
+#
+# Copyright (C) 2024 KonstaKANG
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#      http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+#
+
+LOCAL_PATH := $(call my-dir)
+
+# Microbenchmarks, built on request only.
+
+include $(CLEAR_VARS)
+
+LOCAL_MODULE := ffmpeg_codec2_pending_work_bench
+LOCAL_MODULE_TAGS := optional
+
+LOCAL_SRC_FILES := \
+    pending_work_queue_bench.cpp \
+    ../C2FFMPEGPendingWorkQueue.cpp
+
+LOCAL_C_INCLUDES := $(LOCAL_PATH)/..
+
+include $(BUILD_HOST_EXECUTABLE)
+
+include $(CLEAR_VARS)
+
+LOCAL_MODULE := ffmpeg_codec2_threadpool_bench
+LOCAL_PROPRIETARY_MODULE := true
+LOCAL_MODULE_TAGS := optional
+
+LOCAL_SRC_FILES := \
+    threadpool_bench.cpp
+
+LOCAL_SHARED_LIBRARIES := \
+    libavcodec \
+    libavformat \
+    libavutil \
+    libffmpeg_utils \
+    liblog \
+    libswresample \
+    libswscale \
+    libutils
+
+include $(BUILD_EXECUTABLE)
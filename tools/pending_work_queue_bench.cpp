@@ -0,0 +1,155 @@
+/*
+ * Copyright (C) 2024 KonstaKANG
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Pending work queue against the sorted deque it replaced, on the access
+// pattern of the video decoder: works pushed in decoding order, completed in
+// presentation order once the queue holds the output delay, earlier works
+// pruned on each completion.
+//
+// Standalone, no Android dependency:
+//   g++ -O2 -std=c++17 -I.. pending_work_queue_bench.cpp ../C2FFMPEGPendingWorkQueue.cpp
+
+#include <stdint.h>
+#include <stdio.h>
+#include <algorithm>
+#include <chrono>
+#include <deque>
+#include <utility>
+#include <vector>
+
+#include "C2FFMPEGPendingWorkQueue.h"
+
+using namespace android;
+
+namespace {
+
+constexpr int kWorks = 1000000;
+constexpr int kRuns = 5;
+
+// Implementation before the indexed queue: sorted on each push, linear
+// lookup by frame index.
+class SortedDequeQueue {
+public:
+    typedef std::pair<uint64_t, uint64_t> PendingWork;
+
+    size_t size() const { return mQueue.size(); }
+    bool empty() const { return mQueue.empty(); }
+
+    void push(uint64_t index, uint64_t timestamp) {
+        mQueue.push_back(PendingWork(index, timestamp));
+        std::sort(mQueue.begin(), mQueue.end(), [](const PendingWork& w1, const PendingWork& w2) {
+            return w1.second < w2.second;
+        });
+    }
+    bool erase(uint64_t index) {
+        auto it = std::find_if(mQueue.begin(), mQueue.end(),
+                               [index](const PendingWork& w) { return w.first == index; });
+
+        if (it == mQueue.end()) {
+            return false;
+        }
+        mQueue.erase(it);
+        return true;
+    }
+    uint64_t frontIndex() const { return mQueue.front().first; }
+    uint64_t frontTimestamp() const { return mQueue.front().second; }
+    uint64_t popFront() {
+        uint64_t index = mQueue.front().first;
+
+        mQueue.pop_front();
+        return index;
+    }
+
+private:
+    std::deque<PendingWork> mQueue;
+};
+
+// Presentation timestamps in decoding order of a hierarchical GOP with
+// `depth` reordered pictures: each anchor precedes the pictures it follows.
+std::vector<uint64_t> makeTimestamps(int works, int depth) {
+    std::vector<uint64_t> timestamps;
+    int group = depth + 1;
+
+    timestamps.reserve(works);
+    for (int base = 0; (int)timestamps.size() < works; base += group) {
+        timestamps.push_back((uint64_t)(base + group - 1) * 33333);
+        for (int i = 0; i < group - 1 && (int)timestamps.size() < works; i++) {
+            timestamps.push_back((uint64_t)(base + i) * 33333);
+        }
+    }
+    return timestamps;
+}
+
+// Returns nanoseconds per work: push, completion of the earliest work by
+// index, pruning.
+template <typename Queue>
+double run(const std::vector<uint64_t>& timestamps, size_t outputDelay, uint64_t* checksum) {
+    Queue queue;
+    auto start = std::chrono::steady_clock::now();
+
+    for (size_t i = 0; i < timestamps.size(); i++) {
+        queue.push(i, timestamps[i]);
+        if (queue.size() >= outputDelay) {
+            uint64_t timestamp = queue.frontTimestamp();
+
+            *checksum = *checksum * 31 + queue.frontIndex();
+            queue.erase(queue.frontIndex());
+            while (! queue.empty() && queue.frontTimestamp() < timestamp) {
+                *checksum = *checksum * 31 + queue.popFront();
+            }
+        }
+    }
+
+    auto elapsed = std::chrono::steady_clock::now() - start;
+
+    return std::chrono::duration<double, std::nano>(elapsed).count() / timestamps.size();
+}
+
+template <typename Queue>
+double best(const std::vector<uint64_t>& timestamps, size_t outputDelay, uint64_t* checksum) {
+    double result = 0;
+
+    for (int i = 0; i < kRuns; i++) {
+        double ns = run<Queue>(timestamps, outputDelay, checksum);
+
+        result = (i == 0) ? ns : std::min(result, ns);
+    }
+    return result;
+}
+
+}  // namespace
+
+int main() {
+    static const int kOutputDelays[] = { 8, 18, 34 };
+
+    printf("%12s %16s %16s %8s\n", "output delay", "sorted deque", "indexed heap", "speedup");
+    for (int outputDelay : kOutputDelays) {
+        std::vector<uint64_t> timestamps = makeTimestamps(kWorks, std::min(outputDelay - 1, 15));
+        // Same works completed in the same order, also keeps the loops from
+        // being optimized out.
+        uint64_t checksumBefore = 0;
+        uint64_t checksumAfter = 0;
+        double before = best<SortedDequeQueue>(timestamps, outputDelay, &checksumBefore);
+        double after = best<C2FFMPEGPendingWorkQueue>(timestamps, outputDelay, &checksumAfter);
+
+        if (checksumBefore != checksumAfter) {
+            fprintf(stderr, "output delay %d: works completed differently\n", outputDelay);
+            return 1;
+        }
+        printf("%12d %13.1f ns %13.1f ns %7.1fx\n", outputDelay, before, after, before / after);
+    }
+    return 0;
+}
@@ -0,0 +1,216 @@
+/*
+ * Copyright (C) 2024 KonstaKANG
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Shared worker pool against one slice thread pool per session, as
+// libavcodec creates for each decoder, with N sessions decoding at once.
+// Each frame is a parallel loop over its slices; reports the aggregate frame
+// rate and the 99th percentile frame time.
+//
+// Runs on the device, against libffmpeg_utils.
+
+#include <stdint.h>
+#include <stdio.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "ffmpeg_threadpool.h"
+#include "ffmpeg_utils.h"
+
+using namespace android;
+
+namespace {
+
+constexpr int kFrames = 400;
+constexpr int kSlices = 8;
+constexpr int kSliceWork = 20000;
+
+// Slice threads owned by one session, started with as many threads as there
+// are cores.
+class PrivatePool {
+public:
+    explicit PrivatePool(int threads) : mFn(NULL), mCount(0), mGeneration(0), mStopping(false) {
+        for (int i = 0; i < threads - 1; i++) {
+            mThreads.emplace_back(&PrivatePool::workerLoop, this);
+        }
+    }
+    ~PrivatePool() {
+        {
+            std::lock_guard<std::mutex> lock(mLock);
+            mStopping = true;
+        }
+        mCond.notify_all();
+        for (auto& thread : mThreads) {
+            thread.join();
+        }
+    }
+
+    void parallelFor(int count, const std::function<void(int)>& fn) {
+        {
+            std::lock_guard<std::mutex> lock(mLock);
+            // Next index last: a worker still leaving the previous loop
+            // claims from this one with its function and count.
+            mFn = &fn;
+            mCount = count;
+            mDone = 0;
+            mNext = 0;
+            mGeneration++;
+        }
+        mCond.notify_all();
+        runIndices();
+
+        std::unique_lock<std::mutex> lock(mLock);
+
+        mDoneCond.wait(lock, [this] { return mDone.load() == mCount; });
+    }
+
+private:
+    void runIndices() {
+        int index;
+
+        while ((index = mNext.fetch_add(1)) < mCount) {
+            (*mFn.load())(index);
+            if (mDone.fetch_add(1) + 1 == mCount) {
+                std::lock_guard<std::mutex> lock(mLock);
+                mDoneCond.notify_all();
+            }
+        }
+    }
+    void workerLoop() {
+        std::unique_lock<std::mutex> lock(mLock);
+        uint64_t generation = mGeneration;
+
+        while (true) {
+            mCond.wait(lock, [&] { return mStopping || mGeneration != generation; });
+            if (mStopping) {
+                return;
+            }
+            generation = mGeneration;
+            lock.unlock();
+            runIndices();
+            lock.lock();
+        }
+    }
+
+    std::mutex mLock;
+    std::condition_variable mCond;
+    std::condition_variable mDoneCond;
+    std::vector<std::thread> mThreads;
+    std::atomic<const std::function<void(int)>*> mFn;
+    std::atomic<int> mCount;
+    std::atomic<int> mNext;
+    std::atomic<int> mDone;
+    uint64_t mGeneration;
+    bool mStopping;
+};
+
+uint64_t decodeSlice(uint64_t seed) {
+    for (int i = 0; i < kSliceWork; i++) {
+        seed = seed * 6364136223846793005ull + 1442695040888963407ull;
+    }
+    return seed;
+}
+
+struct Result {
+    double fps;
+    double p99Ms;
+};
+
+// Runs `sessions` decoders at once, each running its frames through the
+// parallel loop made by setup().
+template <typename Setup>
+Result run(int sessions, Setup setup) {
+    std::vector<std::vector<double>> frameMs(sessions);
+    std::vector<std::thread> threads;
+    std::atomic<uint64_t> sink(0);
+    auto start = std::chrono::steady_clock::now();
+
+    for (int s = 0; s < sessions; s++) {
+        threads.emplace_back([&, s] {
+            auto runFrame = setup();
+            uint64_t results[kSlices];
+            std::function<void(int)> fn = [&results, s](int slice) {
+                results[slice] = decodeSlice(s * kSlices + slice);
+            };
+
+            frameMs[s].reserve(kFrames);
+            for (int f = 0; f < kFrames; f++) {
+                auto frameStart = std::chrono::steady_clock::now();
+
+                runFrame(fn);
+                frameMs[s].push_back(std::chrono::duration<double, std::milli>(
+                        std::chrono::steady_clock::now() - frameStart).count());
+                sink += results[f % kSlices];
+            }
+        });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    std::vector<double> all;
+
+    for (auto& ms : frameMs) {
+        all.insert(all.end(), ms.begin(), ms.end());
+    }
+    std::sort(all.begin(), all.end());
+    if (sink.load() == 0) {
+        fprintf(stderr, "no work done\n");
+    }
+    return { sessions * kFrames / seconds, all[all.size() * 99 / 100] };
+}
+
+}  // namespace
+
+int main() {
+    static const int kSessions[] = { 1, 2, 4, 8 };
+    int cpus = ffmpeg_cpu_count();
+
+    printf("%d cores, %d frames of %d slices per session\n", cpus, kFrames, kSlices);
+    printf("%8s %22s %22s\n", "sessions", "private pools", "shared pool");
+    printf("%8s %11s %10s %11s %10s\n", "", "fps", "p99 ms", "fps", "p99 ms");
+    for (int sessions : kSessions) {
+        Result before = run(sessions, [cpus] {
+            auto pool = std::make_shared<PrivatePool>(cpus);
+            return [pool](const std::function<void(int)>& fn) {
+                pool->parallelFor(kSlices, fn);
+            };
+        });
+        Result after = run(sessions, [] {
+            FFmpegThreadPool& pool = FFmpegThreadPool::instance();
+            std::shared_ptr<FFmpegThreadPool::Session> session(
+                    pool.createSession(1), [&pool](FFmpegThreadPool::Session* s) {
+                        pool.destroySession(s);
+                    });
+            return [&pool, session](const std::function<void(int)>& fn) {
+                pool.parallelFor(session.get(), kSlices, kSlices, [&fn](int index, int /* slot */) {
+                    fn(index);
+                });
+            };
+        });
+
+        printf("%8d %11.1f %10.2f %11.1f %10.2f\n", sessions,
+               before.fps, before.p99Ms, after.fps, after.p99Ms);
+    }
+    return 0;
+}